@@ -114,6 +114,11 @@ status_t linux86_start(char* kernel_file, char* initrd_file, char* cmd){
 	entryState.cs = seg + 0x20;
 	entryState.ds = seg;
 
+	if(msio_shutdown){ // no DMA engine may point at memory of the bootloader once the kernel runs
+		status = msio_shutdown();
+		CERROR();
+	}
+
 	kernel_jump(&entryState, 0, KERNEL_S3BOOT_BMODE_16, 1 /* disable interrupts */);
 
 	_end:
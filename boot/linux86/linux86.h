@@ -72,4 +72,7 @@ typedef struct linux86_setup_header{
 
 status_t linux86_start(char* kernel_file, char* initrd_file, char* cmd);
 
+// provided by storage drivers that have to stop their devices before the kernel takes over (drivers/ahci), undefined otherwise
+status_t msio_shutdown() __attribute__((weak));
+
 #endif /* __LINUX86_H__ */
@@ -155,6 +155,11 @@ status_t ubi_start(char* file){
 	status = ubi_post_init();
 	CERROR();
 
+	if(msio_shutdown){ // no DMA engine may point at memory of the bootloader once the kernel runs
+		status = msio_shutdown();
+		CERROR();
+	}
+
 	ubi_status_t kreturn = ubi_call_kernel();
 	log_warn("Kernel returned status %u\n", (size_t) kreturn);
 	kernel_halt(); // at this point it may be too unsafe to return (we dont know what the kernel does)
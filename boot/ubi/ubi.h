@@ -300,5 +300,8 @@ size_t ubi_get_table_size(uint64_t magic);
 uint32_t ubi_convert_to_ubi_memtype(uint32_t memtype);
 size_t ubi_get_random_kernel_offset(size_t kernelBase, size_t kaslrSize);
 
+// provided by storage drivers that have to stop their devices before the kernel takes over (drivers/ahci), undefined otherwise
+status_t msio_shutdown() __attribute__((weak));
+
 
 #endif /* __UBI_H__ */
@@ -28,10 +28,6 @@ static ahci_controller ahci_controllers[AHCI_MAX_HBA_COUNT];
 static uint8_t ahci_hba_count = 0;
 
 static bool ahci_initialized = false;
-static bool ahci_device_mapped = false;
-
-static ahci_rec_fis* ahci_rfis_temp = NULL;
-static ahci_cmd_header* ahci_cmdh_temp = NULL;
 
 
 status_t ahci_detect_hba(int maxBus, int maxSlot){
@@ -149,6 +145,15 @@ status_t ahci_init_hba(uint8_t ahciNum){
 		else
 			ahci_controllers[ahciNum].devices[i].type = ahci_get_device_type(ahci_controllers[ahciNum].devices[i].port);
 		if(ahci_device_present(ahciNum, i) && driveNumCounter < 0xff){
+			// the command list and FIS area stay mapped from now on, commands only fill a slot and set PxCI
+			status = ahci_device_init(&ahci_controllers[ahciNum].devices[i], ahci_controllers[ahciNum].maxCmd);
+			if(status != TSX_SUCCESS){ // only this port is unusable, the structures are kept since the port may still point at them
+				log_warn("AHCI port %u of controller %u could not be initialized (status %u)\n", i, ahciNum, status);
+				ahci_controllers[ahciNum].devices[i].type = HBA_DEV_NONE;
+				ahci_controllers[ahciNum].devices[i].number = 0xff;
+				status = 0;
+				continue;
+			}
 			ahci_controllers[ahciNum].devices[i].number = driveNumCounter;
 			driveNumCounter++;
 		}else
@@ -206,30 +211,56 @@ status_t ahci_dma_engine_stop(hba_port* port){
 	return status;
 }
 
-status_t ahci_device_init(ahci_device* device){
-	status_t status = ahci_port_map(device->port);
+status_t ahci_device_init(ahci_device* device, uint8_t maxCmd){
+	status_t status = 0;
+	device->cmdList = kmalloc_aligned(sizeof(ahci_cmd_header) * 32);
+	if(device->cmdList == NULL)
+		FERROR(TSX_OUT_OF_MEMORY);
+	memset(device->cmdList, 0, sizeof(ahci_cmd_header) * 32);
+	reloc_ptr((void**) &device->cmdList);
+
+	device->recFis = kmalloc_aligned(sizeof(ahci_rec_fis));
+	if(device->recFis == NULL)
+		FERROR(TSX_OUT_OF_MEMORY);
+	memset((void*) device->recFis, 0, sizeof(ahci_rec_fis));
+	reloc_ptr((void**) &device->recFis);
+
+	device->cmdTables = kmalloc_aligned(sizeof(ahci_cmd_table) * maxCmd);
+	if(device->cmdTables == NULL)
+		FERROR(TSX_OUT_OF_MEMORY);
+	memset(device->cmdTables, 0, sizeof(ahci_cmd_table) * maxCmd);
+	reloc_ptr((void**) &device->cmdTables);
+	device->cmdTableCount = maxCmd;
+
+	status = ahci_port_map(device);
 	CERROR();
-	device->flags |= 2;
 	_end:
 	return status;
 }
 
-status_t ahci_port_map(hba_port* port){
+status_t ahci_port_map(ahci_device* device){ // (re)starts the port with the command list, FIS area and command tables of device
 	status_t status = 0;
-	if(ahci_device_mapped)
-		FERROR(10);
+	hba_port* port = device->port;
 	status = ahci_dma_engine_stop(port);
 	CERROR();
 
-	port->pxfb = (uint32_t) vmmgr_get_physical((size_t) (ahci_rfis_temp));
+	for(int i = 0; i < device->cmdTableCount; i++){
+		device->cmdList[i].ctba0 = (uint32_t) vmmgr_get_physical((size_t) (&device->cmdTables[i]));
+		device->cmdList[i].ctba_u0 = 0;
+	}
+
+	port->pxfb = (uint32_t) vmmgr_get_physical((size_t) (device->recFis));
 	port->pxfbu = 0;
 
-	port->pxclb = (uint32_t) vmmgr_get_physical((size_t) (ahci_cmdh_temp));
+	port->pxclb = (uint32_t) vmmgr_get_physical((size_t) (device->cmdList));
 	port->pxclbu = 0;
 
-	ahci_device_mapped = true;
+	port->pxserr = (uint32_t) -1;
+	port->pxis = (uint32_t) -1;
+
 	status = ahci_dma_engine_start(port);
 	CERROR();
+	device->flags |= 2;
 	_end:
 	return status;
 }
@@ -245,23 +276,25 @@ status_t ahci_device_reset(ahci_device* device){
 	port->pxclb = 0;
 	port->pxclbu = 0;
 
-	ahci_device_mapped = false;
 	device->flags &= ~2;
 	_end:
 	return status;
 }
 
-status_t ahci_device_reset_all(){
+status_t ahci_device_reset_all(){ // stops every mapped port so that nothing points at memory of the bootloader anymore
 	status_t status = 0;
-	for(int ahciNum = 0; ahciNum < ahci_hba_count; ahciNum++){
-		for(int i = 0; i < 32; i++){
-			if(ahci_controllers[ahciNum].devices[i].flags & 0x2){
-				status = ahci_device_reset(&ahci_controllers[ahciNum].devices[i]);
-				CERROR();
-			}
+	for(uint8_t ahciNum = 0; ahciNum < ahci_hba_count; ahciNum++){
+		if(!ahci_controller_initialized(ahciNum))
+			continue;
+		for(uint8_t i = 0; i < 32; i++){
+			ahci_device* device = &ahci_controllers[ahciNum].devices[i];
+			if(!(device->flags & 2))
+				continue;
+			status_t portStatus = ahci_device_reset(device);
+			if(portStatus != TSX_SUCCESS && status == TSX_SUCCESS) // the remaining ports are still reset
+				status = portStatus;
 		}
 	}
-	_end:
 	return status;
 }
 
@@ -289,42 +322,37 @@ uint8_t ahci_cmd_next_slot(hba_port* port, uint8_t maxCmd){
 }
 
 status_t ahci_create_command(uint8_t ahciNum, uint8_t portNum, uint64_t lba, uint16_t count, uint16_t prdt_entries, uint8_t command, ahci_cmd_table** tableWrite,
-		size_t* tableSizeWrite, uint8_t* slotWrite){
+		uint8_t* slotWrite){
 	status_t status = 0;
-	void* prdt = 0;
 	if(!ahci_controller_initialized(ahciNum))
 		FERROR(TSX_CONTROLLER_NOT_INITIALIZED);
 	if(!ahci_device_present(ahciNum, portNum))
 		FERROR(TSX_NO_DEVICE);
-	if(ahci_device_mapped){
-		status = ahci_device_reset_all();
-		CERROR();
-	}
+	if(prdt_entries > AHCI_PRDT_ENTRIES)
+		FERROR(TSX_TOO_LARGE);
 	ahci_device* device = &ahci_controllers[ahciNum].devices[portNum];
-	status = ahci_device_init(device);
-	CERROR();
 	hba_port* port = device->port;
-	port->pxis = (uint32_t) -1;
-	uint8_t slot = ahci_cmd_next_slot(port, ahci_controllers[ahciNum].maxCmd);
+	uint8_t slot = ahci_cmd_next_slot(port, device->cmdTableCount);
 	if(slot == 0xff)
 		FERROR(TSX_PORT_BUFFER_FULL);
+	// the port only needs to be set up again if it was reset or any of the structures were relocated
+	if(!(device->flags & 2) || port->pxclb != (uint32_t) vmmgr_get_physical((size_t) (device->cmdList)) ||
+			port->pxfb != (uint32_t) vmmgr_get_physical((size_t) (device->recFis)) ||
+			device->cmdList[slot].ctba0 != (uint32_t) vmmgr_get_physical((size_t) (&device->cmdTables[slot]))){
+		status = ahci_port_map(device);
+		CERROR();
+	}
+	port->pxis = (uint32_t) -1;
 
-	size_t cmdTableSize = sizeof(ahci_cmd_table) + prdt_entries * sizeof(ahci_prdt);
-	prdt = kmalloc_aligned(cmdTableSize);
-	if(!prdt)
-		FERROR(TSX_OUT_OF_MEMORY);
-	memset(prdt, 0, cmdTableSize);
+	ahci_cmd_table* table = &device->cmdTables[slot];
+	memset(table, 0, sizeof(ahci_cmd_table) - (AHCI_PRDT_ENTRIES - prdt_entries) * sizeof(ahci_prdt));
 
-	ahci_cmd_header* header = ahci_cmdh_temp;
-	header += slot;
-	memset(header, 0, sizeof(ahci_cmd_header));
+	ahci_cmd_header* header = &device->cmdList[slot];
 	header->prdtl = prdt_entries;
-	header->ctba0 = (uint32_t) vmmgr_get_physical((size_t) prdt);
-	header->ctba_u0 = 0;
+	header->prdbc = 0;
 	header->flags = (sizeof(ahci_fis_h2d_reg) / 4) & 0x1f;
-	header->flags &= ~0x40;
-
-	ahci_cmd_table* table = prdt;
+	if(command == ATA_CMD_DMA_WRITE)
+		header->flags |= 0x40;
 
 	ahci_fis_h2d_reg* cmdf = (ahci_fis_h2d_reg*) (&table->cfis);
 	cmdf->type = 0x27;
@@ -341,10 +369,8 @@ status_t ahci_create_command(uint8_t ahciNum, uint8_t portNum, uint64_t lba, uin
 	cmdf->count = count;
 
 	*tableWrite = table;
-	*tableSizeWrite = cmdTableSize;
+	*slotWrite = slot;
 	_end:
-	if(prdt && status != TSX_SUCCESS)
-		kfree_aligned(prdt, cmdTableSize);
 	return status;
 }
 
@@ -362,6 +388,7 @@ status_t ahci_issue_command(uint8_t ahciNum, uint8_t portNum, uint8_t slot){
 
 	port->pxci = 1 << slot;
 
+	// busy-wait, most commands complete well within the 1ms a sleep would take
 	wait_timeout = arch_time();
 	while(1){
 		if((port->pxci & (1 << slot)) == 0)
@@ -373,44 +400,44 @@ status_t ahci_issue_command(uint8_t ahciNum, uint8_t portNum, uint8_t slot){
 		if(port->pxis & 0x78000000){
 			FERROR(19);
 		}
-		arch_sleep(1);
 	}
-	status = ahci_device_reset(device);
-	CERROR();
 	_end:
+	if(status != TSX_SUCCESS){ // the engine has to be restarted to clear the error and the command
+		status_t mapStatus = ahci_port_map(device);
+		if(mapStatus != TSX_SUCCESS){ // the port is stuck, no further commands are issued to it
+			log_warn("AHCI port %u of controller %u could not be restarted (status %u)\n", portNum, ahciNum, mapStatus);
+			device->type = HBA_DEV_NONE;
+			status = mapStatus;
+		}
+	}
 	return status;
 }
 
 status_t ahci_device_io(uint8_t ahciNum, uint8_t portNum, uint64_t lba, uint16_t secCount, size_t mem, bool action){
 	status_t status = 0;
-
 	ahci_cmd_table* table = 0;
-	size_t tableSize = 0;
 	uint8_t slot = 0;
-	uint16_t prdt_entries = (uint16_t) ((secCount - 1) >> 4) + 1;
-	status = ahci_create_command(ahciNum, portNum, lba, secCount, prdt_entries, action ? ATA_CMD_DMA_WRITE : ATA_CMD_DMA_READ, &table, &tableSize, &slot);
+	if(secCount == 0)
+		goto _end;
+	size_t bytes = (size_t) secCount * 512;
+	uint16_t prdt_entries = (uint16_t) ((bytes - 1) / AHCI_PRDT_MAX_BYTES) + 1;
+	status = ahci_create_command(ahciNum, portNum, lba, secCount, prdt_entries, action ? ATA_CMD_DMA_WRITE : ATA_CMD_DMA_READ, &table, &slot);
 	CERROR();
 
-	uint16_t sec_left = secCount;
 	mem = vmmgr_get_physical(mem);
-	for(int i = 0; i < prdt_entries - 1; i++){
+	for(int i = 0; i < prdt_entries; i++){
+		size_t entryBytes = bytes > AHCI_PRDT_MAX_BYTES ? AHCI_PRDT_MAX_BYTES : bytes;
 		table->prdt_entry[i].dba = mem;
 		table->prdt_entry[i].dbau = 0;
-		table->prdt_entry[i].flags = 8191;
+		table->prdt_entry[i].flags = entryBytes - 1;
 		table->prdt_entry[i].flags |= 0x80000000;
-		mem += 8192;
-		sec_left -= 16;
+		mem += entryBytes;
+		bytes -= entryBytes;
 	}
-	table->prdt_entry[prdt_entries - 1].dba = mem;
-	table->prdt_entry[prdt_entries - 1].dbau = 0;
-	table->prdt_entry[prdt_entries - 1].flags = (sec_left * 512) - 1;
-	table->prdt_entry[prdt_entries - 1].flags |= 0x80000000;
 
 	status = ahci_issue_command(ahciNum, portNum, slot);
 	CERROR();
 	_end:
-	if(table)
-		kfree_aligned(table, tableSize);
 	return status;
 }
 
@@ -421,10 +448,9 @@ status_t ahci_device_info(uint8_t ahciNum, uint8_t portNum, uint64_t* sectors, s
 		FERROR(TSX_OUT_OF_MEMORY);
 
 	ahci_cmd_table* table = 0;
-	size_t tableSize = 0;
 	uint8_t slot = 0;
 	uint16_t prdt_entries = 1;
-	status = ahci_create_command(ahciNum, portNum, 0, 0, prdt_entries, ATA_CMD_IDENTIFY, &table, &tableSize, &slot);
+	status = ahci_create_command(ahciNum, portNum, 0, 0, prdt_entries, ATA_CMD_IDENTIFY, &table, &slot);
 	CERROR();
 
 	table->prdt_entry[0].dba = vmmgr_get_physical((size_t) tmpBuf);
@@ -444,8 +470,6 @@ status_t ahci_device_info(uint8_t ahciNum, uint8_t portNum, uint64_t* sectors, s
 		*sectorSize = 512;
 	}
 	_end:
-	if(table)
-		kfree_aligned(table, tableSize);
 	if(tmpBuf)
 		kfree_aligned(tmpBuf, 512);
 	return status;
@@ -456,18 +480,6 @@ static char* msio_driver_type = "ahci";
 status_t msio_init(){
 	status_t status = 0;
 	if(!ahci_initialized){
-		ahci_rfis_temp = kmalloc_aligned(sizeof(ahci_rec_fis));
-		if(ahci_rfis_temp == NULL)
-			FERROR(TSX_OUT_OF_MEMORY);
-		memset((void*) ahci_rfis_temp, 0, sizeof(ahci_rec_fis));
-		reloc_ptr((void**) &ahci_rfis_temp);
-
-		ahci_cmdh_temp = kmalloc_aligned(sizeof(ahci_cmd_header) * 32);
-		if(ahci_cmdh_temp == NULL)
-			FERROR(TSX_OUT_OF_MEMORY);
-		memset(ahci_cmdh_temp, 0, sizeof(ahci_cmd_header) * 32);
-		reloc_ptr((void**) &ahci_cmdh_temp);
-
 		status = ahci_init();
 		CERROR();
 	}
@@ -475,6 +487,12 @@ status_t msio_init(){
 	return status;
 }
 
+status_t msio_shutdown(){ // called by the boot modules right before control is handed to the loaded kernel
+	if(!ahci_initialized)
+		return TSX_SUCCESS;
+	return ahci_device_reset_all();
+}
+
 status_t msio_get_device_info(uint8_t number, uint64_t* sectors, size_t* sectorSize){
 	status_t status = 0;
 	if(!ahci_initialized){
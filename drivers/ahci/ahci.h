@@ -28,6 +28,10 @@
 #define ATA_CMD_DMA_WRITE 0x35
 #define ATA_CMD_IDENTIFY 0xec
 
+// PRDT entries in each command table, one entry covers up to AHCI_PRDT_MAX_BYTES (8 entries fit the largest command of 65535 sectors)
+#define AHCI_PRDT_ENTRIES 8
+#define AHCI_PRDT_MAX_BYTES 0x400000
+
 #pragma pack(push,1)
 typedef volatile struct hba_memory{
 	uint32_t cap; // host_cap
@@ -179,7 +183,7 @@ typedef struct ahci_cmd_table{
 	uint8_t cfis[64]; // command fis
 	uint8_t acmd[16]; // ATAPI command
 	uint8_t reserved[48]; // reserved
-	ahci_prdt prdt_entry[1];
+	ahci_prdt prdt_entry[AHCI_PRDT_ENTRIES];
 } ahci_cmd_table;
 
 
@@ -188,6 +192,10 @@ typedef struct ahci_device{
 	uint8_t flags; // 0 reserved, 1 mapped, 7:2 reserved
 	uint8_t number;
 	hba_port* port;
+	ahci_cmd_header* cmdList; // 32 headers, the header of each slot points at the table of that slot in cmdTables
+	ahci_rec_fis* recFis;
+	ahci_cmd_table* cmdTables; // one per command slot
+	uint8_t cmdTableCount;
 } ahci_device;
 
 typedef struct ahci_controller{
@@ -212,17 +220,19 @@ status_t ahci_init_hba(uint8_t ahciNum);
 bool ahci_controller_initialized(uint8_t ahciNum);
 status_t ahci_dma_engine_start(hba_port* port);
 status_t ahci_dma_engine_stop(hba_port* port);
-status_t ahci_device_init(ahci_device* device);
-status_t ahci_port_map(hba_port* port);
+status_t ahci_device_init(ahci_device* device, uint8_t maxCmd);
+status_t ahci_port_map(ahci_device* device);
 status_t ahci_device_reset(ahci_device* device);
+status_t ahci_device_reset_all();
 uint8_t ahci_cmd_next_slot(hba_port* port, uint8_t maxCmd);
 status_t ahci_create_command(uint8_t ahciNum, uint8_t portNum, uint64_t lba, uint16_t count, uint16_t prdt_entries, uint8_t command, ahci_cmd_table** tableWrite,
-		size_t* tableSizeWrite, uint8_t* slotWrite);
+		uint8_t* slotWrite);
 status_t ahci_issue_command(uint8_t ahciNum, uint8_t portNum, uint8_t slot);
 status_t ahci_device_io(uint8_t ahciNum, uint8_t portNum, uint64_t lba, uint16_t secCount, size_t mem, bool action);
 status_t ahci_device_info(uint8_t ahciNum, uint8_t portNum, uint64_t* sectors, size_t* sectorSize);
 
 status_t msio_init();
+status_t msio_shutdown();
 status_t msio_get_device_info(uint8_t number, uint64_t* sectors, size_t* sectorSize);
 status_t msio_read(uint8_t number, uint64_t sector, uint16_t sectorCount, size_t dest);
 status_t msio_write(uint8_t number, uint64_t sector, uint16_t sectorCount, size_t source);
@@ -16,368 +16,2789 @@
 #include <klibc/string.h>
 #include <kernel/msio.h>
 #include <kernel/util.h>
+#include <kernel/kutil.h>
 #include <kernel/list.h>
 #include <kernel/log.h>
 #include "ext.h"
 
 
 static uint32_t ext_incompat_support = EXT_INCOMPAT_FILETYPE | EXT_INCOMPAT_64BIT | EXT_INCOMPAT_EXTENTS | EXT_INCOMPAT_FLEX_BG |
-	EXT_INCOMPAT_RECOVER | EXT_INCOMPAT_JOURNAL_DEV;
+	EXT_INCOMPAT_RECOVER | EXT_INCOMPAT_JOURNAL_DEV | EXT_INCOMPAT_META_BG | EXT_INCOMPAT_LARGEDIR | EXT_INCOMPAT_INLINE_DATA;
 
+static ext_mount ext_mounts[EXT_MAX_MOUNTS];
+static size_t ext_mount_next_evict = 0;
 
-status_t ext_get_file(char* driveLabel, uint64_t partStart, char* path, uint32_t* inode){
+// heap use of the module, shared by all mounts
+static size_t ext_alloc_bytes = 0;
+static size_t ext_alloc_peak = 0;
+static uint64_t ext_alloc_calls = 0;
+
+static uint32_t ext_crc32c_table[8][256];
+static bool ext_crc32c_ready = FALSE;
+
+
+status_t ext_mount_get(char* driveLabel, uint64_t partStart, ext_mount** mountWrite){
+	status_t status = 0;
+	ext_mount* mount = ext_mount_find(driveLabel, partStart);
+	if(mount){
+		mount->stats.mountHits++;
+		mount->stats.sbReadsSaved++;
+		*mountWrite = mount;
+		goto _end;
+	}
+	for(size_t i = 0; i < EXT_MAX_MOUNTS; i++){
+		if(!(ext_mounts[i].flags & 1)){
+			mount = &ext_mounts[i];
+			break;
+		}
+	}
+	if(!mount){ // all slots in use, replace one
+		mount = &ext_mounts[ext_mount_next_evict];
+		ext_mount_next_evict = (ext_mount_next_evict + 1) % EXT_MAX_MOUNTS;
+		ext_mount_invalidate(mount);
+	}
+	memset(mount, 0, sizeof(ext_mount));
+
+	mount->partStart = partStart;
+	mount->driveLabelSize = strlen(driveLabel) + 1;
+	mount->driveLabel = ext_kmalloc(mount->driveLabelSize);
+	if(!mount->driveLabel)
+		FERROR(TSX_OUT_OF_MEMORY);
+	memcpy(mount->driveLabel, driveLabel, mount->driveLabelSize);
+	reloc_ptr((void**) &mount->driveLabel);
+
+	ext_superblock* sb = ext_kmalloc_aligned(1024);
+	if(!sb)
+		FERROR(TSX_OUT_OF_MEMORY);
+	status = ext_dev_read(mount, EXT_IO_SUPERBLOCK, partStart + 2, 2, (size_t) sb);
+	if(status == TSX_SUCCESS){
+		if(sb->s_magic != EXT_MAGIC)
+			status = TSX_INVALID_FORMAT;
+		else if(sb->s_feature_incompat & ~ext_incompat_support)
+			status = TSX_UNSUPPORTED;
+		else if(EXT_VERIFY_CHECKSUMS && (sb->s_feature_ro_compat & EXT_RO_COMPAT_METADATA_CSUM) && !ext_sb_csum_verify(sb))
+			status = TSX_INVALID_FORMAT;
+		else
+			memcpy(&mount->sb, sb, sizeof(ext_superblock));
+	}
+	ext_kfree_aligned(sb, 1024);
+	CERROR();
+
+	mount->blockSize = util_math_pow(2, 10 + mount->sb.s_log_block_size);
+	mount->descSize = (mount->sb.s_feature_incompat & EXT_INCOMPAT_64BIT) ? mount->sb.s_desc_size : 32;
+	mount->inodeSize = mount->sb.s_rev_level > 0 ? mount->sb.s_inode_size : 128;
+	mount->groupCount = mount->sb.s_inodes_count / mount->sb.s_inodes_per_group;
+	if(EXT_VERIFY_CHECKSUMS && (mount->sb.s_feature_ro_compat & EXT_RO_COMPAT_METADATA_CSUM)){
+		mount->flags |= 2;
+		if(mount->sb.s_feature_incompat & EXT_INCOMPAT_CSUM_SEED)
+			mount->csumSeed = mount->sb.s_checksum_seed;
+		else
+			mount->csumSeed = ext_crc32c(0xffffffff, mount->sb.s_uuid, sizeof(mount->sb.s_uuid));
+	}
+
+	mount->flags |= 1;
+
+	// group descriptors are read one sector at a time when an inode in the group is first needed
+	status = ext_lru_init(&mount->groupCache, EXT_GROUP_CACHE_SIZE, sizeof(ext_group_cache_entry));
+	CERROR();
+	status = ext_lru_init(&mount->inodeCache, EXT_INODE_CACHE_SIZE, sizeof(ext_inode_cache_entry) + ((mount->inodeSize + 7) & ~7));
+	CERROR();
+	status = ext_lru_init(&mount->dentryCache, EXT_DENTRY_CACHE_SIZE, sizeof(ext_dentry_cache_entry));
+	CERROR();
+	status = ext_lru_init(&mount->blockCache, EXT_BLOCK_CACHE_SIZE / mount->blockSize, sizeof(ext_block_cache_entry));
+	CERROR();
+	if(mount->blockCache.capacity > 0){
+		mount->blockCacheData = ext_kmalloc_aligned(mount->blockCache.capacity * mount->blockSize);
+		if(!mount->blockCacheData)
+			FERROR(TSX_OUT_OF_MEMORY);
+		reloc_ptr((void**) &mount->blockCacheData);
+	}
+	mount->scratchSize = MAX(EXT_SCRATCH_BLOCKS * mount->blockSize, EXT_BATCH_BOUNCE_SIZE) + EXT_SCRATCH_EXTRA;
+	mount->scratch = ext_kmalloc_aligned(mount->scratchSize);
+	if(!mount->scratch)
+		FERROR(TSX_OUT_OF_MEMORY);
+	reloc_ptr((void**) &mount->scratch);
+
+	mount->stats.mountMisses++;
+	*mountWrite = mount;
+	_end:
+	if(status != TSX_SUCCESS && mount)
+		ext_mount_invalidate(mount);
+	return status;
+}
+
+ext_mount* ext_mount_find(char* driveLabel, uint64_t partStart){
+	for(size_t i = 0; i < EXT_MAX_MOUNTS; i++){
+		if((ext_mounts[i].flags & 1) && ext_mounts[i].partStart == partStart && strcmp(ext_mounts[i].driveLabel, driveLabel) == 0)
+			return &ext_mounts[i];
+	}
+	return NULL;
+}
+
+void ext_mount_invalidate(ext_mount* mount){
+	ext_plan_free(mount);
+	ext_lru_free(&mount->groupCache);
+	ext_lru_free(&mount->inodeCache);
+	ext_lru_free(&mount->dentryCache);
+	if(mount->blockCacheData){
+		del_reloc_ptr((void**) &mount->blockCacheData);
+		ext_kfree_aligned(mount->blockCacheData, mount->blockCache.capacity * mount->blockSize);
+	}
+	ext_lru_free(&mount->blockCache);
+	if(mount->scratch){
+		del_reloc_ptr((void**) &mount->scratch);
+		ext_kfree_aligned(mount->scratch, mount->scratchSize);
+	}
+	if(mount->driveLabel){
+		del_reloc_ptr((void**) &mount->driveLabel);
+		ext_kfree(mount->driveLabel, mount->driveLabelSize);
+	}
+	memset(mount, 0, sizeof(ext_mount));
+}
+
+void ext_invalidate(char* driveLabel, uint64_t partStart){ // driveLabel NULL invalidates all mounts
+	for(size_t i = 0; i < EXT_MAX_MOUNTS; i++){
+		if(!(ext_mounts[i].flags & 1))
+			continue;
+		if(driveLabel && !(ext_mounts[i].partStart == partStart && strcmp(ext_mounts[i].driveLabel, driveLabel) == 0))
+			continue;
+		ext_mount_invalidate(&ext_mounts[i]);
+	}
+}
+
+status_t ext_get_stats(char* driveLabel, uint64_t partStart, ext_stats* statsWrite){
+	ext_mount* mount = ext_mount_find(driveLabel, partStart);
+	if(!mount)
+		return TSX_NO_DEVICE;
+	memcpy(statsWrite, &mount->stats, sizeof(ext_stats));
+	statsWrite->allocBytes = ext_alloc_bytes;
+	statsWrite->allocPeakBytes = ext_alloc_peak;
+	statsWrite->allocCalls = ext_alloc_calls;
+	return TSX_SUCCESS;
+}
+
+void ext_io_dump(char* driveLabel, uint64_t partStart){ // logs where the reads of a mount came from
+	static char* causeNames[EXT_IO_CAUSES] = {"superblock", "gdt", "inode", "directory", "indirect", "extent", "data", "plan"};
+	ext_mount* mount = ext_mount_find(driveLabel, partStart);
+	if(!mount)
+		return;
+	log_info("ext: %s+%u: %u reads, %u sectors\n", mount->driveLabel, (size_t) partStart, (size_t) mount->stats.deviceReads, (size_t) mount->stats.deviceSectors);
+	for(size_t i = 0; i < EXT_IO_CAUSES; i++){
+		ext_io_counter* counter = &mount->stats.io[i];
+		if(counter->commands > 0)
+			log_info("ext:   %s: %u reads, %u sectors, %u ms\n", causeNames[i], (size_t) counter->commands, (size_t) counter->sectors, (size_t) counter->timeMs);
+	}
+#if EXT_IO_TRACE_SIZE > 0
+	size_t count = MIN(mount->traceNext, EXT_IO_TRACE_SIZE);
+	for(size_t i = mount->traceNext - count; i < mount->traceNext; i++){
+		ext_io_trace_entry* entry = &mount->trace[i % EXT_IO_TRACE_SIZE];
+		log_debug("ext:   %s lba %Y sectors %u (%u ms)\n", causeNames[entry->cause], (size_t) entry->lba, (size_t) entry->sectors, (size_t) entry->timeMs);
+	}
+#endif
+}
+
+void ext_alloc_reset_peak(){ // starts a new measurement of the peak allocation
+	ext_alloc_peak = ext_alloc_bytes;
+}
+
+status_t ext_dev_read(ext_mount* mount, uint8_t cause, uint64_t lba, uint64_t count, size_t dest){ // every device read of a mount goes through here
+	status_t status = 0;
+	while(count > 0){
+		uint16_t sectors = MIN(count, EXT_MAX_TRANSFER_SECTORS);
+		size_t start = arch_time();
+		status = msio_read_drive(mount->driveLabel, lba, sectors, dest);
+		CERROR();
+		size_t time = arch_time() - start;
+		mount->stats.deviceReads++;
+		mount->stats.deviceSectors += sectors;
+		mount->stats.io[cause].commands++;
+		mount->stats.io[cause].sectors += sectors;
+		mount->stats.io[cause].timeMs += time;
+#if EXT_IO_TRACE_SIZE > 0
+		ext_io_trace_entry* entry = &mount->trace[mount->traceNext++ % EXT_IO_TRACE_SIZE];
+		entry->lba = lba;
+		entry->sectors = sectors;
+		entry->cause = cause;
+		entry->timeMs = time;
+#endif
+		lba += sectors;
+		dest += sectors * 512;
+		count -= sectors;
+	}
+	_end:
+	return status;
+}
+
+status_t ext_dev_write(ext_mount* mount, uint64_t lba, uint64_t count, size_t source){
+	status_t status = 0;
+	while(count > 0){
+		uint16_t sectors = MIN(count, EXT_MAX_TRANSFER_SECTORS);
+		status = msio_write_drive(mount->driveLabel, lba, sectors, source);
+		CERROR();
+		mount->stats.deviceWrites++;
+		lba += sectors;
+		source += sectors * 512;
+		count -= sectors;
+	}
+	_end:
+	return status;
+}
+
+void* ext_kmalloc(size_t size){
+	void* ptr = kmalloc(size);
+	if(ptr)
+		ext_alloc_add(size);
+	return ptr;
+}
+
+void ext_kfree(void* ptr, size_t size){
+	kfree(ptr, size);
+	ext_alloc_bytes -= size;
+}
+
+void* ext_kmalloc_aligned(size_t size){
+	void* ptr = kmalloc_aligned(size);
+	if(ptr)
+		ext_alloc_add(size);
+	return ptr;
+}
+
+void ext_kfree_aligned(void* ptr, size_t size){
+	kfree_aligned(ptr, size);
+	ext_alloc_bytes -= size;
+}
+
+void ext_alloc_add(size_t size){
+	ext_alloc_bytes += size;
+	ext_alloc_calls++;
+	if(ext_alloc_bytes > ext_alloc_peak)
+		ext_alloc_peak = ext_alloc_bytes;
+}
+
+void* ext_scratch_alloc(ext_mount* mount, size_t size){ // temporary buffer usable for device reads, must be freed with ext_scratch_free
+	size_t start = (mount->scratchUsed + EXT_SCRATCH_ALIGN - 1) & ~(EXT_SCRATCH_ALIGN - 1);
+	if(!mount->scratch || size > mount->scratchSize || start > mount->scratchSize - size){
+		mount->stats.scratchFallbacks++;
+		return ext_kmalloc_aligned(size);
+	}
+	mount->scratchUsed = start + size;
+	mount->scratchLive++;
+	mount->stats.scratchAllocs++;
+	return mount->scratch + start;
+}
+
+void ext_scratch_free(ext_mount* mount, void* ptr, size_t size){
+	if(!mount->scratch || ptr < mount->scratch || ptr >= mount->scratch + mount->scratchSize){
+		ext_kfree_aligned(ptr, size);
+		return;
+	}
+	// buffers are usually freed in reverse order, one freed out of order stays in use until the arena is empty
+	mount->scratchLive--;
+	if(mount->scratchLive == 0)
+		mount->scratchUsed = 0;
+	else if(ptr + size == mount->scratch + mount->scratchUsed)
+		mount->scratchUsed = ptr - mount->scratch;
+}
+
+bool ext_scratch_grow(ext_mount* mount, void* ptr, size_t size, size_t newSize){ // resizes ptr in place if it is the last buffer of the arena
+	if(!mount->scratch || ptr < mount->scratch || ptr + size != mount->scratch + mount->scratchUsed)
+		return FALSE;
+	if(newSize > mount->scratchSize - (ptr - mount->scratch))
+		return FALSE;
+	mount->scratchUsed = (ptr - mount->scratch) + newSize;
+	return TRUE;
+}
+
+status_t ext_group_inode_table(ext_mount* mount, uint32_t group, uint64_t* inodeTableWrite){
+	status_t status = 0;
+	void* buf = NULL;
+	for(uint32_t index = ext_lru_first(&mount->groupCache, group); index != EXT_LRU_NONE; index = ext_lru_next(&mount->groupCache, index)){
+		ext_group_cache_entry* entry = ext_lru_entry(&mount->groupCache, index);
+		if(entry->group != group)
+			continue;
+		ext_lru_touch(&mount->groupCache, index);
+		mount->stats.groupCacheHits++;
+		mount->stats.descReadsSaved++;
+		*inodeTableWrite = entry->inodeTable;
+		goto _end;
+	}
+	mount->stats.groupCacheMisses++;
+	if(group >= mount->groupCount)
+		FERROR(TSX_INVALID_FORMAT);
+	// only the sector holding the descriptor is read
+	uint32_t descPerBlock = mount->blockSize / mount->descSize;
+	size_t descOffset = (group % descPerBlock) * mount->descSize;
+	uint64_t descBlock = ext_group_desc_block(mount, group / descPerBlock);
+	buf = ext_scratch_alloc(mount, 512);
+	if(!buf)
+		FERROR(TSX_OUT_OF_MEMORY);
+	status = ext_dev_read(mount, EXT_IO_GDT, mount->partStart + descBlock * (mount->blockSize / 512) + descOffset / 512, 1, (size_t) buf);
+	CERROR();
+	ext_group_desc* desc = buf + descOffset % 512;
+	if((mount->flags & 2) && !ext_group_desc_csum_verify(mount, group, desc))
+		FERROR(TSX_INVALID_FORMAT);
+	uint64_t inodeTable = desc->bg_inode_table_lo;
+	if((mount->sb.s_feature_incompat & EXT_INCOMPAT_64BIT) && mount->descSize > 32)
+		inodeTable |= ((uint64_t) desc->bg_inode_table_hi) << 32;
+	uint32_t index = ext_lru_insert(&mount->groupCache, group);
+	if(index != EXT_LRU_NONE){
+		ext_group_cache_entry* entry = ext_lru_entry(&mount->groupCache, index);
+		entry->group = group;
+		entry->inodeTable = inodeTable;
+	}
+	*inodeTableWrite = inodeTable;
+	_end:
+	if(buf)
+		ext_scratch_free(mount, buf, 512);
+	return status;
+}
+
+uint64_t ext_group_desc_block(ext_mount* mount, uint32_t descBlock){ // location of the n-th block of group descriptors
+	uint64_t firstBlock = mount->sb.s_first_data_block;
+	if(!(mount->sb.s_feature_incompat & EXT_INCOMPAT_META_BG) || descBlock < mount->sb.s_first_meta_bg)
+		return firstBlock + 1 + descBlock;
+	// with meta_bg, every meta group keeps its descriptor block in its first group, after the superblock backup if there is one
+	uint32_t group = descBlock * (mount->blockSize / mount->descSize);
+	uint64_t block = firstBlock + (uint64_t) group * mount->sb.s_blocks_per_group;
+	if(ext_group_has_super(mount, group))
+		block++;
+	if(mount->blockSize == 1024 && descBlock == 0 && firstBlock == 0)
+		block++;
+	return block;
+}
+
+bool ext_group_has_super(ext_mount* mount, uint32_t group){
+	if(group == 0)
+		return TRUE;
+	if(mount->sb.s_feature_compat & EXT_COMPAT_SPARSE_SUPER2)
+		return group == mount->sb.s_backup_bgs[0] || group == mount->sb.s_backup_bgs[1];
+	if(group <= 1 || !(mount->sb.s_feature_ro_compat & EXT_RO_COMPAT_SPARSE_SUPER))
+		return TRUE;
+	if(!(group & 1))
+		return FALSE;
+	return ext_is_power(group, 3) || ext_is_power(group, 5) || ext_is_power(group, 7);
+}
+
+bool ext_is_power(uint32_t value, uint32_t base){
+	uint64_t power = base;
+	while(power < value)
+		power *= base;
+	return power == value;
+}
+
+status_t ext_block_get(ext_mount* mount, uint64_t block, uint8_t cause, void** dataWrite){ // data must be released with ext_block_put
+	status_t status = 0;
+	void* data = NULL;
+	uint64_t lba = mount->partStart + block * mount->blockSize / 512;
+	uint32_t hash = (uint32_t) lba ^ (uint32_t) (lba >> 32);
+	uint32_t index = ext_block_find(mount, lba);
+	if(index != EXT_LRU_NONE){
+		ext_block_cache_entry* entry = ext_lru_entry(&mount->blockCache, index);
+		ext_lru_touch(&mount->blockCache, index);
+		entry->link.refs++;
+		mount->stats.blockCacheHits++;
+		mount->stats.blockCacheBytesSaved += mount->blockSize;
+		*dataWrite = mount->blockCacheData + index * mount->blockSize;
+		goto _end;
+	}
+	mount->stats.blockCacheMisses++;
+	index = ext_lru_insert(&mount->blockCache, hash);
+	if(index != EXT_LRU_NONE){
+		data = mount->blockCacheData + index * mount->blockSize;
+	}else{ // cache disabled or every entry is in use
+		data = ext_scratch_alloc(mount, mount->blockSize);
+		if(!data)
+			FERROR(TSX_OUT_OF_MEMORY);
+	}
+	status = ext_dev_read(mount, cause, lba, mount->blockSize / 512, (size_t) data);
+	if(status != TSX_SUCCESS){
+		if(index != EXT_LRU_NONE)
+			ext_lru_remove(&mount->blockCache, index);
+		else
+			ext_scratch_free(mount, data, mount->blockSize);
+		goto _end;
+	}
+	if(index != EXT_LRU_NONE){
+		ext_block_cache_entry* entry = ext_lru_entry(&mount->blockCache, index);
+		entry->lba = lba;
+		entry->link.refs = 1;
+	}
+	*dataWrite = data;
+	_end:
+	return status;
+}
+
+void ext_block_put(ext_mount* mount, void* data){
+	ext_block_cache_entry* entry = ext_block_entry(mount, data);
+	if(entry){
+		if(entry->link.refs > 0)
+			entry->link.refs--;
+	}else{
+		ext_scratch_free(mount, data, mount->blockSize);
+	}
+}
+
+uint32_t ext_block_find(ext_mount* mount, uint64_t lba){
+	uint32_t hash = (uint32_t) lba ^ (uint32_t) (lba >> 32);
+	for(uint32_t index = ext_lru_first(&mount->blockCache, hash); index != EXT_LRU_NONE; index = ext_lru_next(&mount->blockCache, index)){
+		ext_block_cache_entry* entry = ext_lru_entry(&mount->blockCache, index);
+		if(entry->lba == lba)
+			return index;
+	}
+	return EXT_LRU_NONE;
+}
+
+status_t ext_block_prefetch(ext_mount* mount, uint64_t* blocks, size_t count, uint8_t cause){ // reads the given blocks into the block cache, blocks is sorted in place
+	status_t status = 0;
+	size_t blockSize = mount->blockSize;
+	size_t maxBlocks = EXT_MAX_TRANSFER_SECTORS / (blockSize / 512);
+	void* buf = NULL;
+	size_t bufBlocks = 0;
+	// insertion sort, batches are at most half the cache
+	for(size_t i = 1; i < count; i++){
+		uint64_t block = blocks[i];
+		size_t j = i;
+		for(; j > 0 && blocks[j - 1] > block; j--)
+			blocks[j] = blocks[j - 1];
+		blocks[j] = block;
+	}
+	for(size_t i = 0; i < count;){
+		if((i > 0 && blocks[i] == blocks[i - 1]) || ext_block_find(mount, mount->partStart + blocks[i] * blockSize / 512) != EXT_LRU_NONE){
+			i++;
+			continue;
+		}
+		// merge blocks that are physically close into a single read, the blocks in small gaps are read and discarded
+		uint64_t first = blocks[i];
+		size_t n = 1;
+		size_t last = i + 1;
+		for(; last < count; last++){
+			if(blocks[last] < first + n)
+				continue;
+			if(blocks[last] - (first + n) > EXT_PREFETCH_MAX_GAP || blocks[last] + 1 - first > maxBlocks ||
+				ext_block_find(mount, mount->partStart + blocks[last] * blockSize / 512) != EXT_LRU_NONE)
+				break;
+			n = blocks[last] + 1 - first;
+		}
+		if(n > bufBlocks){
+			if(buf)
+				ext_scratch_free(mount, buf, bufBlocks * blockSize);
+			bufBlocks = n;
+			buf = ext_scratch_alloc(mount, bufBlocks * blockSize);
+			if(!buf)
+				FERROR(TSX_OUT_OF_MEMORY);
+		}
+		status = ext_dev_read(mount, cause, mount->partStart + first * blockSize / 512, n * blockSize / 512, (size_t) buf);
+		CERROR();
+		mount->stats.prefetchReads++;
+		for(; i < last; i++){
+			if(i > 0 && blocks[i] == blocks[i - 1])
+				continue;
+			uint64_t lba = mount->partStart + blocks[i] * blockSize / 512;
+			uint32_t index = ext_lru_insert(&mount->blockCache, (uint32_t) lba ^ (uint32_t) (lba >> 32));
+			if(index == EXT_LRU_NONE)
+				continue;
+			ext_block_cache_entry* entry = ext_lru_entry(&mount->blockCache, index);
+			entry->lba = lba;
+			memcpy(mount->blockCacheData + index * blockSize, buf + (blocks[i] - first) * blockSize, blockSize);
+			mount->stats.prefetchBlocks++;
+		}
+	}
+	_end:
+	if(buf)
+		ext_scratch_free(mount, buf, bufBlocks * blockSize);
+	return status;
+}
+
+ext_block_cache_entry* ext_block_entry(ext_mount* mount, void* data){ // NULL if data is not in the block cache
+	size_t cacheSize = mount->blockCache.capacity * mount->blockSize;
+	if(mount->blockCacheData && data >= mount->blockCacheData && data < mount->blockCacheData + cacheSize)
+		return ext_lru_entry(&mount->blockCache, (data - mount->blockCacheData) / mount->blockSize);
+	return NULL;
+}
+
+bool ext_block_verified(ext_mount* mount, void* data){
+	ext_block_cache_entry* entry = ext_block_entry(mount, data);
+	return entry && (entry->link.flags & EXT_BLOCK_VERIFIED);
+}
+
+void ext_block_set_verified(ext_mount* mount, void* data){
+	ext_block_cache_entry* entry = ext_block_entry(mount, data);
+	if(entry)
+		entry->link.flags |= EXT_BLOCK_VERIFIED;
+}
+
+
+status_t ext_lru_init(ext_lru* lru, uint32_t capacity, size_t entrySize){
+	status_t status = 0;
+	memset(lru, 0, sizeof(ext_lru));
+	lru->head = EXT_LRU_NONE;
+	lru->tail = EXT_LRU_NONE;
+	if(capacity == 0)
+		goto _end;
+	lru->bucketCount = 1;
+	while(lru->bucketCount < capacity)
+		lru->bucketCount <<= 1;
+	lru->buckets = ext_kmalloc(lru->bucketCount * sizeof(uint32_t));
+	if(!lru->buckets)
+		FERROR(TSX_OUT_OF_MEMORY);
+	memset(lru->buckets, 0xff, lru->bucketCount * sizeof(uint32_t));
+	reloc_ptr((void**) &lru->buckets);
+	lru->entries = ext_kmalloc(capacity * entrySize);
+	if(!lru->entries)
+		FERROR(TSX_OUT_OF_MEMORY);
+	reloc_ptr((void**) &lru->entries);
+	lru->entrySize = entrySize;
+	lru->capacity = capacity;
+	_end:
+	return status;
+}
+
+void ext_lru_free(ext_lru* lru){
+	if(lru->buckets){
+		del_reloc_ptr((void**) &lru->buckets);
+		ext_kfree(lru->buckets, lru->bucketCount * sizeof(uint32_t));
+	}
+	if(lru->entries){
+		del_reloc_ptr((void**) &lru->entries);
+		ext_kfree(lru->entries, lru->capacity * lru->entrySize);
+	}
+	memset(lru, 0, sizeof(ext_lru));
+}
+
+void* ext_lru_entry(ext_lru* lru, uint32_t index){
+	return lru->entries + (size_t) index * lru->entrySize;
+}
+
+uint32_t ext_lru_first(ext_lru* lru, uint32_t hash){
+	if(lru->capacity == 0)
+		return EXT_LRU_NONE;
+	return lru->buckets[hash & (lru->bucketCount - 1)];
+}
+
+uint32_t ext_lru_next(ext_lru* lru, uint32_t index){
+	return ((ext_lru_link*) ext_lru_entry(lru, index))->hashNext;
+}
+
+void ext_lru_unlink(ext_lru* lru, uint32_t index){
+	ext_lru_link* link = ext_lru_entry(lru, index);
+	if(link->prev != EXT_LRU_NONE)
+		((ext_lru_link*) ext_lru_entry(lru, link->prev))->next = link->next;
+	else
+		lru->head = link->next;
+	if(link->next != EXT_LRU_NONE)
+		((ext_lru_link*) ext_lru_entry(lru, link->next))->prev = link->prev;
+	else
+		lru->tail = link->prev;
+}
+
+void ext_lru_unlink_hash(ext_lru* lru, uint32_t index){
+	ext_lru_link* link = ext_lru_entry(lru, index);
+	uint32_t* prevNext = &lru->buckets[link->hash & (lru->bucketCount - 1)];
+	while(*prevNext != EXT_LRU_NONE){
+		if(*prevNext == index){
+			*prevNext = link->hashNext;
+			break;
+		}
+		prevNext = &((ext_lru_link*) ext_lru_entry(lru, *prevNext))->hashNext;
+	}
+	link->flags &= ~1;
+}
+
+void ext_lru_touch(ext_lru* lru, uint32_t index){
+	if(lru->head == index)
+		return;
+	ext_lru_link* link = ext_lru_entry(lru, index);
+	ext_lru_unlink(lru, index);
+	link->prev = EXT_LRU_NONE;
+	link->next = lru->head;
+	((ext_lru_link*) ext_lru_entry(lru, lru->head))->prev = index;
+	lru->head = index;
+}
+
+uint32_t ext_lru_insert(ext_lru* lru, uint32_t hash){
+	uint32_t index = EXT_LRU_NONE;
+	if(lru->capacity == 0)
+		return EXT_LRU_NONE;
+	ext_lru_link* link = NULL;
+	if(lru->used < lru->capacity){
+		index = lru->used++;
+		link = ext_lru_entry(lru, index);
+		link->prev = EXT_LRU_NONE;
+		link->next = lru->head;
+		if(lru->head != EXT_LRU_NONE)
+			((ext_lru_link*) ext_lru_entry(lru, lru->head))->prev = index;
+		else
+			lru->tail = index;
+		lru->head = index;
+	}else{
+		// reuse the least recently used entry that is not referenced
+		for(index = lru->tail; index != EXT_LRU_NONE; index = link->prev){
+			link = ext_lru_entry(lru, index);
+			if(link->refs == 0)
+				break;
+		}
+		if(index == EXT_LRU_NONE)
+			return EXT_LRU_NONE;
+		if(link->flags & 1)
+			ext_lru_unlink_hash(lru, index);
+		ext_lru_touch(lru, index);
+	}
+	uint32_t* bucket = &lru->buckets[hash & (lru->bucketCount - 1)];
+	link->hash = hash;
+	link->hashNext = *bucket;
+	link->refs = 0;
+	link->flags = 1;
+	*bucket = index;
+	return index;
+}
+
+void ext_lru_remove(ext_lru* lru, uint32_t index){
+	ext_lru_link* link = ext_lru_entry(lru, index);
+	if(!(link->flags & 1))
+		return;
+	ext_lru_unlink_hash(lru, index);
+	// move to the tail so that the entry is reused first
+	if(lru->tail == index)
+		return;
+	ext_lru_unlink(lru, index);
+	link->next = EXT_LRU_NONE;
+	link->prev = lru->tail;
+	((ext_lru_link*) ext_lru_entry(lru, lru->tail))->next = index;
+	lru->tail = index;
+}
+
+
+status_t ext_get_file(ext_mount* mount, char* path, uint32_t* inode){
+	status_t status = 0;
+
+	uint32_t cInode;
+	uint8_t cType;
+	status = ext_get_path_inode(mount, path, &cInode, &cType);
+	CERROR();
+
+	if(cType != EXT_INODE_TYPE_FILE)
+		FERROR(TSX_NO_SUCH_FILE);
+	if(inode)
+		*inode = cInode;
+	_end:
+	return status;
+}
+
+status_t ext_get_dir(ext_mount* mount, char* path, uint32_t* inode){
+	status_t status = 0;
+	size_t pathlen = strlen(path) + 1;
+	char* pathcpy = ext_scratch_alloc(mount, pathlen);
+	if(!pathcpy)
+		FERROR(TSX_OUT_OF_MEMORY);
+	memcpy(pathcpy, path, pathlen);
+	for(size_t i = pathlen - 1; i > 0; i--){ // cut trailing file name ("/path/to/file" -> "/path/to/")
+		if(pathcpy[i] != '/')
+			pathcpy[i] = 0;
+		else
+			break;
+	}
+	uint32_t cInode;
+	uint8_t cType;
+	status = ext_get_path_inode(mount, pathcpy, &cInode, &cType);
+	ext_scratch_free(mount, pathcpy, pathlen);
+	CERROR();
+	if(cType != EXT_INODE_TYPE_DIRECTORY)
+		FERROR(TSX_NO_SUCH_DIRECTORY);
+	if(inode)
+		*inode = cInode;
+	_end:
+	return status;
+}
+
+status_t ext_get_path_inode(ext_mount* mount, char* path, uint32_t* inode, uint8_t* type){
+	status_t status = 0;
+	uint32_t cInode = 2 /* root inode */;
+	uint8_t cType = EXT_INODE_TYPE_DIRECTORY;
+	ext_file dir;
+	char* linkPath = NULL; // path after the last followed symbolic link
+	size_t linkPathSize = 0;
+	size_t links = 0;
+
+	while(*path){
+		if(*path == '/'){
+			path++;
+			continue;
+		}
+		size_t pathpartlen = 0;
+		while(!(path[pathpartlen] == '/' || path[pathpartlen] == 0))
+			pathpartlen++;
+		if(cType != EXT_INODE_TYPE_DIRECTORY)
+			FERROR(TSX_NO_SUCH_DIRECTORY);
+		uint32_t nInode = 0;
+		uint8_t nType = 0;
+		if(!ext_dentry_lookup(mount, cInode, path, pathpartlen, &nInode, &nType)){
+			status = ext_file_open(mount, cInode, &dir);
+			CERROR();
+			status = ext_dir_find(&dir, path, pathpartlen, &nInode, &nType);
+			ext_file_close(&dir);
+			CERROR();
+			ext_dentry_insert(mount, cInode, path, pathpartlen, nInode, nType);
+		}
+		path += pathpartlen;
+		if(!nInode){
+			FERROR(*path ? TSX_NO_SUCH_DIRECTORY : TSX_NO_SUCH_FILE);
+		}
+		if(nType == EXT_INODE_TYPE_SYMLINK){
+			if(++links > EXT_MAX_SYMLINKS)
+				FERROR(TSX_INVALID_FORMAT);
+			// continue with the link target followed by the rest of the path, relative to the directory containing the link
+			status = ext_symlink_resolve(mount, nInode, path, &linkPath, &linkPathSize);
+			CERROR();
+			path = linkPath;
+			if(*path == '/')
+				cInode = 2;
+			continue;
+		}
+		cInode = nInode;
+		cType = nType;
+	}
+
+	if(inode)
+		*inode = cInode;
+	if(type)
+		*type = cType;
+	_end:
+	if(linkPath)
+		ext_scratch_free(mount, linkPath, linkPathSize);
+	return status;
+}
+
+status_t ext_symlink_resolve(ext_mount* mount, uint32_t inode, char* rest, char** pathWrite, size_t* pathSizeWrite){ // replaces *pathWrite with the link target followed by rest
+	status_t status = 0;
+	char* path = NULL;
+	size_t pathSize = 0;
+	ext_file link;
+	status = ext_file_open(mount, inode, &link);
+	CERROR();
+	uint64_t targetLen = ext_inode_size(mount, &link.inodeData);
+	if(targetLen == 0 || targetLen >= mount->blockSize)
+		FERROR(TSX_INVALID_FORMAT);
+	size_t restLen = strlen(rest);
+	pathSize = targetLen + restLen + 1;
+	path = ext_scratch_alloc(mount, pathSize);
+	if(!path)
+		FERROR(TSX_OUT_OF_MEMORY);
+	if(targetLen < sizeof(link.inodeData.i_blocks) + 12 /* i_block_i1 - i_block_i3 */){ // fast symlink, the target is stored in i_block
+		memcpy(path, link.inodeData.i_blocks, targetLen);
+	}else{
+		status = ext_read_inode_range(&link, 0, targetLen, path, NULL);
+		CERROR();
+	}
+	memcpy(path + targetLen, rest, restLen + 1);
+	if(*pathWrite)
+		ext_scratch_free(mount, *pathWrite, *pathSizeWrite);
+	*pathWrite = path;
+	*pathSizeWrite = pathSize;
+	path = NULL;
+	_end:
+	if(path)
+		ext_scratch_free(mount, path, pathSize);
+	ext_file_close(&link);
+	return status;
+}
+
+status_t ext_dir_find(ext_file* dir, char* name, size_t nameLen, uint32_t* inodeWrite, uint8_t* typeWrite){ // inode is 0 if there is no such entry
+	status_t status = 0;
+	*inodeWrite = 0;
+	status = ext_dx_lookup(dir, name, nameLen, inodeWrite, typeWrite);
+	if(status != TSX_UNSUPPORTED)
+		goto _end;
+	status = 0;
+	if(dir->inlineData){
+		// the parent inode number comes first, "." and ".." have no entries in inline directories
+		if(nameLen == 1 && name[0] == '.'){
+			*inodeWrite = dir->inode;
+			*typeWrite = EXT_INODE_TYPE_DIRECTORY;
+		}else if(nameLen == 2 && name[0] == '.' && name[1] == '.'){
+			*inodeWrite = *((uint32_t*) dir->inlineData);
+			*typeWrite = EXT_INODE_TYPE_DIRECTORY;
+		}else if(dir->inlineSize > 4){
+			ext_dir_block_find(dir->inlineData + 4, dir->inlineSize - 4, name, nameLen, inodeWrite, typeWrite);
+		}
+		goto _end;
+	}
+	// linear scan, one directory block at a time, stopping at the first match
+	uint64_t blocks = (ext_inode_size(dir->mount, &dir->inodeData) + dir->mount->blockSize - 1) / dir->mount->blockSize;
+	for(uint64_t i = 0; i < blocks; i++){
+		uint64_t devBlock = 0;
+		status = ext_bmap(dir, i, &devBlock);
+		CERROR();
+		if(!devBlock)
+			continue;
+		void* block = NULL;
+		status = ext_block_get(dir->mount, devBlock, EXT_IO_DIRECTORY, &block);
+		CERROR();
+		status = ext_dir_block_verify(dir, block);
+		if(status != TSX_SUCCESS){
+			ext_block_put(dir->mount, block);
+			goto _end;
+		}
+		bool found = ext_dir_block_find(block, dir->mount->blockSize, name, nameLen, inodeWrite, typeWrite);
+		ext_block_put(dir->mount, block);
+		if(found)
+			break;
+	}
+	_end:
+	return status;
+}
+
+bool ext_dir_block_find(void* block, size_t size, char* name, size_t nameLen, uint32_t* inodeWrite, uint8_t* typeWrite){
+	for(size_t off = 0; off + sizeof(ext_dir_entry) <= size;){
+		ext_dir_entry* dirEntry = (ext_dir_entry*) ((size_t) block + off);
+		if(dirEntry->rec_len < sizeof(ext_dir_entry) || off + dirEntry->rec_len > size)
+			break;
+		if(dirEntry->inode && nameLen == dirEntry->name_len && strncmp(dirEntry->name, name, dirEntry->name_len) == 0){
+			*inodeWrite = dirEntry->inode;
+			*typeWrite = dirEntry->file_type;
+			return TRUE;
+		}
+		off += dirEntry->rec_len;
+	}
+	return FALSE;
+}
+
+status_t ext_dir_iterate(ext_file* dir, ext_dir_callback callback, void* arg){ // stops at and returns the first non-zero status returned by callback
+	status_t status = 0;
+	if(dir->inlineData){
+		// inline directories have no "." and ".." entries, they are reported like in block directories
+		status = callback(arg, dir->inode, EXT_INODE_TYPE_DIRECTORY, ".", 1);
+		CERROR();
+		status = callback(arg, *((uint32_t*) dir->inlineData), EXT_INODE_TYPE_DIRECTORY, "..", 2);
+		CERROR();
+		// the parent inode number comes first
+		if(dir->inlineSize > 4)
+			status = ext_dir_block_iterate(dir->inlineData + 4, dir->inlineSize - 4, callback, arg);
+		goto _end;
+	}
+	// every block passes through the block cache, nothing is allocated per block or per entry
+	uint64_t blocks = (ext_inode_size(dir->mount, &dir->inodeData) + dir->mount->blockSize - 1) / dir->mount->blockSize;
+	uint64_t readahead[EXT_DIR_READAHEAD];
+	uint64_t mapped[EXT_DIR_READAHEAD]; // device block of every block of the current readahead window, 0 for holes
+	uint64_t mappedEnd = 0;
+	bool useReadahead = dir->mount->blockCache.capacity >= EXT_DIR_READAHEAD * 2;
+	for(uint64_t i = 0; i < blocks; i++){
+		if(useReadahead && i % EXT_DIR_READAHEAD == 0 && blocks - i > 1){
+			size_t count = 0;
+			for(uint64_t j = i; j < blocks && j < i + EXT_DIR_READAHEAD; j++){
+				status = ext_bmap(dir, j, &mapped[j - i]);
+				CERROR();
+				if(mapped[j - i])
+					readahead[count++] = mapped[j - i];
+			}
+			mappedEnd = MIN(blocks, i + EXT_DIR_READAHEAD);
+			if(count > 1)
+				ext_block_prefetch(dir->mount, readahead, count, EXT_IO_DIRECTORY); // errors show up again when the block is read below
+		}
+		uint64_t devBlock = 0;
+		if(i < mappedEnd){ // windows start at multiples of EXT_DIR_READAHEAD
+			devBlock = mapped[i % EXT_DIR_READAHEAD];
+		}else{
+			status = ext_bmap(dir, i, &devBlock);
+			CERROR();
+		}
+		if(!devBlock)
+			continue;
+		void* block = NULL;
+		status = ext_block_get(dir->mount, devBlock, EXT_IO_DIRECTORY, &block);
+		CERROR();
+		status = ext_dir_block_verify(dir, block);
+		if(status == TSX_SUCCESS)
+			status = ext_dir_block_iterate(block, dir->mount->blockSize, callback, arg);
+		ext_block_put(dir->mount, block);
+		CERROR();
+	}
+	_end:
+	return status;
+}
+
+status_t ext_dir_block_iterate(void* block, size_t size, ext_dir_callback callback, void* arg){
+	for(size_t off = 0; off + sizeof(ext_dir_entry) <= size;){
+		ext_dir_entry* dirEntry = (ext_dir_entry*) ((size_t) block + off);
+		if(dirEntry->rec_len < sizeof(ext_dir_entry) || off + dirEntry->rec_len > size)
+			break;
+		if(dirEntry->inode && dirEntry->name_len > 0){
+			status_t status = callback(arg, dirEntry->inode, dirEntry->file_type, dirEntry->name, dirEntry->name_len);
+			if(status != TSX_SUCCESS)
+				return status;
+		}
+		off += dirEntry->rec_len;
+	}
+	return TSX_SUCCESS;
+}
+
+// memory handed to the caller is allocated with kmalloc directly, it is not part of the heap use of the module
+
+status_t ext_name_pool_add(void* arg, uint32_t inode, uint8_t type, char* name, size_t nameLen){ // ext_dir_callback appending to an ext_name_pool
+	ext_name_pool* pool = arg;
+	if(pool->length + nameLen + 1 > pool->size){
+		size_t size = MAX(pool->size * 2, EXT_NAME_POOL_MIN_SIZE);
+		while(size < pool->length + nameLen + 1)
+			size *= 2;
+		char* data = kmalloc(size);
+		if(!data)
+			return TSX_OUT_OF_MEMORY;
+		if(pool->data){
+			memcpy(data, pool->data, pool->length);
+			kfree(pool->data, pool->size);
+		}
+		pool->data = data;
+		pool->size = size;
+	}
+	memcpy(pool->data + pool->length, name, nameLen);
+	pool->data[pool->length + nameLen] = 0;
+	pool->length += nameLen + 1;
+	pool->count++;
+	return TSX_SUCCESS;
+}
+
+void ext_name_pool_free(ext_name_pool* pool){
+	if(pool->data)
+		kfree(pool->data, pool->size);
+	memset(pool, 0, sizeof(ext_name_pool));
+}
+
+status_t ext_dir_list_add(void* arg, uint32_t inode, uint8_t type, char* name, size_t nameLen){ // ext_dir_callback pushing a separately allocated copy of each name
+	char* copy = kmalloc(nameLen + 1);
+	if(!copy)
+		return TSX_OUT_OF_MEMORY;
+	memcpy(copy, name, nameLen);
+	copy[nameLen] = 0;
+	status_t status = list_array_push((list_array*) arg, copy);
+	if(status != TSX_SUCCESS)
+		kfree(copy, nameLen + 1);
+	return status;
+}
+
+status_t ext_dx_lookup(ext_file* dir, char* name, size_t nameLen, uint32_t* inodeWrite, uint8_t* typeWrite){ // returns TSX_UNSUPPORTED if the directory must be searched linearly
+	status_t status = 0;
+	ext_mount* mount = dir->mount;
+	ext_dx_frame frames[EXT_DX_MAX_LEVELS];
+	memset(frames, 0, sizeof(frames));
+	size_t levels = 0;
+	void* leaf = NULL;
+	*inodeWrite = 0;
+	if(!(mount->sb.s_feature_compat & EXT_COMPAT_DIR_INDEX) || !(dir->inodeData.i_flags & EXT_INODE_INDEX_FL))
+		FERROR(TSX_UNSUPPORTED);
+	// the root block starts with the "." and ".." entries (12 bytes each), the second one covers the rest of the block
+	status = ext_dx_read_node(dir, 0, 24 + sizeof(ext_dx_root_info), &frames[0]);
+	CERROR();
+	levels = 1;
+	ext_dx_root_info* info = (ext_dx_root_info*) ((size_t) frames[0].block + 24);
+	uint8_t maxLevels = (mount->sb.s_feature_incompat & EXT_INCOMPAT_LARGEDIR) ? 3 : 2;
+	if(info->reserved_zero != 0 || info->info_length != sizeof(ext_dx_root_info) || info->indirect_levels >= maxLevels || info->hash_version > EXT_DX_HASH_TEA)
+		FERROR(TSX_UNSUPPORTED);
+	uint8_t version = info->hash_version;
+	if(mount->sb.s_flags & EXT_FLAGS_UNSIGNED_HASH)
+		version += EXT_DX_HASH_LEGACY_UNSIGNED;
+	uint32_t hash = ext_dx_hash(mount, version, name, nameLen);
+	size_t indirectLevels = info->indirect_levels;
+	for(size_t level = 0;; level++){
+		frames[level].at = ext_dx_search(frames[level].entries, hash);
+		if(!frames[level].at)
+			FERROR(TSX_INVALID_FORMAT);
+		if(level == indirectLevels)
+			break;
+		// index nodes start with an empty directory entry covering the entire block
+		status = ext_dx_read_node(dir, frames[level].at->block & 0x0fffffff, sizeof(ext_dir_entry), &frames[level + 1]);
+		CERROR();
+		levels++;
+	}
+	while(1){
+		uint64_t devBlock = 0;
+		status = ext_bmap(dir, frames[levels - 1].at->block & 0x0fffffff, &devBlock);
+		CERROR();
+		if(!devBlock)
+			FERROR(TSX_INVALID_FORMAT);
+		status = ext_block_get(mount, devBlock, EXT_IO_DIRECTORY, &leaf);
+		CERROR();
+		status = ext_dir_block_verify(dir, leaf);
+		CERROR();
+		if(ext_dir_block_find(leaf, mount->blockSize, name, nameLen, inodeWrite, typeWrite))
+			break;
+		ext_block_put(mount, leaf);
+		leaf = NULL;
+		// names with colliding hashes may continue in the next leaf
+		bool more = FALSE;
+		status = ext_dx_next_leaf(dir, frames, levels, hash, &more);
+		CERROR();
+		if(!more)
+			break;
+	}
+	_end:
+	if(leaf)
+		ext_block_put(mount, leaf);
+	for(size_t i = 0; i < EXT_DX_MAX_LEVELS; i++){
+		if(frames[i].block)
+			ext_block_put(mount, frames[i].block);
+	}
+	return status;
+}
+
+status_t ext_dx_read_node(ext_file* dir, uint32_t fileBlock, size_t entriesOffset, ext_dx_frame* frame){
+	status_t status = 0;
+	ext_mount* mount = dir->mount;
+	uint64_t devBlock = 0;
+	if(frame->block)
+		ext_block_put(mount, frame->block);
+	frame->block = NULL;
+	status = ext_bmap(dir, fileBlock, &devBlock);
+	CERROR();
+	if(!devBlock)
+		FERROR(TSX_INVALID_FORMAT);
+	status = ext_block_get(mount, devBlock, EXT_IO_DIRECTORY, &frame->block);
+	CERROR();
+	frame->entries = (ext_dx_entry*) ((size_t) frame->block + entriesOffset);
+	frame->at = frame->entries;
+	ext_dx_countlimit* countlimit = (ext_dx_countlimit*) frame->entries;
+	if(countlimit->count == 0 || countlimit->count > countlimit->limit || countlimit->limit > (mount->blockSize - entriesOffset) / sizeof(ext_dx_entry))
+		FERROR(TSX_INVALID_FORMAT);
+	_end:
+	return status;
+}
+
+ext_dx_entry* ext_dx_search(ext_dx_entry* entries, uint32_t hash){ // last entry with a hash at or below hash, the first entry covers everything below entries[1]
+	size_t count = ((ext_dx_countlimit*) entries)->count;
+	size_t low = 1;
+	size_t high = count;
+	while(low < high){
+		size_t mid = low + (high - low) / 2;
+		if(entries[mid].hash > hash)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	return &entries[low - 1];
+}
+
+status_t ext_dx_next_leaf(ext_file* dir, ext_dx_frame* frames, size_t levels, uint32_t hash, bool* moreWrite){
+	status_t status = 0;
+	*moreWrite = FALSE;
+	size_t level = levels - 1;
+	while(frames[level].at + 1 >= frames[level].entries + ((ext_dx_countlimit*) frames[level].entries)->count){
+		if(level == 0)
+			goto _end;
+		level--;
+	}
+	frames[level].at++;
+	// a set lowest bit marks a leaf continuing the hash of the previous one
+	if((frames[level].at->hash & ~1) != hash)
+		goto _end;
+	for(level++; level < levels; level++){
+		status = ext_dx_read_node(dir, frames[level - 1].at->block & 0x0fffffff, sizeof(ext_dir_entry), &frames[level]);
+		CERROR();
+	}
+	*moreWrite = TRUE;
+	_end:
+	return status;
+}
+
+uint32_t ext_dx_hash(ext_mount* mount, uint8_t version, char* name, size_t nameLen){
+	uint32_t buf[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+	uint32_t in[8];
+	uint32_t hash = 0;
+	uint32_t* seed = mount->sb.s_hash_seed;
+	if(seed[0] || seed[1] || seed[2] || seed[3])
+		memcpy(buf, seed, sizeof(buf));
+	bool sign = version < EXT_DX_HASH_LEGACY_UNSIGNED;
+	switch(version){
+		case EXT_DX_HASH_LEGACY:
+		case EXT_DX_HASH_LEGACY_UNSIGNED:
+			hash = ext_dx_hash_legacy(name, nameLen, sign);
+			break;
+		case EXT_DX_HASH_HALF_MD4:
+		case EXT_DX_HASH_HALF_MD4_UNSIGNED:
+			for(size_t off = 0; off < nameLen; off += 32){
+				ext_dx_str2hashbuf(name + off, nameLen - off, in, 8, sign);
+				ext_dx_half_md4_transform(buf, in);
+			}
+			hash = buf[1];
+			break;
+		case EXT_DX_HASH_TEA:
+		case EXT_DX_HASH_TEA_UNSIGNED:
+			for(size_t off = 0; off < nameLen; off += 16){
+				ext_dx_str2hashbuf(name + off, nameLen - off, in, 4, sign);
+				ext_dx_tea_transform(buf, in);
+			}
+			hash = buf[0];
+			break;
+	}
+	hash &= ~1;
+	if(hash == 0x7fffffffU << 1) // reserved for end-of-directory
+		hash = 0x7ffffffeU << 1;
+	return hash;
+}
+
+uint32_t ext_dx_hash_legacy(char* name, size_t nameLen, bool sign){
+	uint32_t hash0 = 0x12a3fe2d;
+	uint32_t hash1 = 0x37abe8f9;
+	for(size_t i = 0; i < nameLen; i++){
+		int32_t c = sign ? (int32_t) (int8_t) name[i] : (int32_t) (uint8_t) name[i];
+		uint32_t hash = hash1 + (hash0 ^ (uint32_t) (c * 7152373));
+		if(hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	return hash0 << 1;
+}
+
+void ext_dx_str2hashbuf(char* msg, size_t len, uint32_t* buf, size_t num, bool sign){
+	uint32_t pad = (uint32_t) len | ((uint32_t) len << 8);
+	pad |= pad << 16;
+	uint32_t val = pad;
+	if(len > num * 4)
+		len = num * 4;
+	for(size_t i = 0; i < len; i++){
+		int32_t c = sign ? (int32_t) (int8_t) msg[i] : (int32_t) (uint8_t) msg[i];
+		val = (uint32_t) c + (val << 8);
+		if((i % 4) == 3){
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if(num > 0){
+		*buf++ = val;
+		num--;
+	}
+	while(num > 0){
+		*buf++ = pad;
+		num--;
+	}
+}
+
+#define EXT_DX_ROL(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+#define EXT_DX_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define EXT_DX_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define EXT_DX_H(x, y, z) ((x) ^ (y) ^ (z))
+#define EXT_DX_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = EXT_DX_ROL(a, s))
+#define EXT_DX_K2 013240474631U
+#define EXT_DX_K3 015666365641U
+
+void ext_dx_half_md4_transform(uint32_t* buf, uint32_t* in){
+	uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+	EXT_DX_ROUND(EXT_DX_F, a, b, c, d, in[0], 3);
+	EXT_DX_ROUND(EXT_DX_F, d, a, b, c, in[1], 7);
+	EXT_DX_ROUND(EXT_DX_F, c, d, a, b, in[2], 11);
+	EXT_DX_ROUND(EXT_DX_F, b, c, d, a, in[3], 19);
+	EXT_DX_ROUND(EXT_DX_F, a, b, c, d, in[4], 3);
+	EXT_DX_ROUND(EXT_DX_F, d, a, b, c, in[5], 7);
+	EXT_DX_ROUND(EXT_DX_F, c, d, a, b, in[6], 11);
+	EXT_DX_ROUND(EXT_DX_F, b, c, d, a, in[7], 19);
+
+	EXT_DX_ROUND(EXT_DX_G, a, b, c, d, in[1] + EXT_DX_K2, 3);
+	EXT_DX_ROUND(EXT_DX_G, d, a, b, c, in[3] + EXT_DX_K2, 5);
+	EXT_DX_ROUND(EXT_DX_G, c, d, a, b, in[5] + EXT_DX_K2, 9);
+	EXT_DX_ROUND(EXT_DX_G, b, c, d, a, in[7] + EXT_DX_K2, 13);
+	EXT_DX_ROUND(EXT_DX_G, a, b, c, d, in[0] + EXT_DX_K2, 3);
+	EXT_DX_ROUND(EXT_DX_G, d, a, b, c, in[2] + EXT_DX_K2, 5);
+	EXT_DX_ROUND(EXT_DX_G, c, d, a, b, in[4] + EXT_DX_K2, 9);
+	EXT_DX_ROUND(EXT_DX_G, b, c, d, a, in[6] + EXT_DX_K2, 13);
+
+	EXT_DX_ROUND(EXT_DX_H, a, b, c, d, in[3] + EXT_DX_K3, 3);
+	EXT_DX_ROUND(EXT_DX_H, d, a, b, c, in[7] + EXT_DX_K3, 9);
+	EXT_DX_ROUND(EXT_DX_H, c, d, a, b, in[2] + EXT_DX_K3, 11);
+	EXT_DX_ROUND(EXT_DX_H, b, c, d, a, in[6] + EXT_DX_K3, 15);
+	EXT_DX_ROUND(EXT_DX_H, a, b, c, d, in[1] + EXT_DX_K3, 3);
+	EXT_DX_ROUND(EXT_DX_H, d, a, b, c, in[5] + EXT_DX_K3, 9);
+	EXT_DX_ROUND(EXT_DX_H, c, d, a, b, in[0] + EXT_DX_K3, 11);
+	EXT_DX_ROUND(EXT_DX_H, b, c, d, a, in[4] + EXT_DX_K3, 15);
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+void ext_dx_tea_transform(uint32_t* buf, uint32_t* in){
+	uint32_t sum = 0;
+	uint32_t b0 = buf[0], b1 = buf[1];
+	uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+	for(int n = 0; n < 16; n++){
+		sum += 0x9e3779b9;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	}
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+status_t ext_dir_block_verify(ext_file* dir, void* block){ // checks the tail entry of a directory leaf block if it has one
+	ext_mount* mount = dir->mount;
+	if(!(mount->flags & 2) || ext_block_verified(mount, block))
+		return TSX_SUCCESS;
+	size_t size = mount->blockSize - sizeof(ext_dir_entry_tail);
+	ext_dir_entry_tail* tail = (ext_dir_entry_tail*) (block + size);
+	if(tail->det_reserved_zero1 == 0 && tail->det_rec_len == sizeof(ext_dir_entry_tail) && tail->det_reserved_ft == EXT_DIR_TAIL_FT){
+		if(ext_crc32c(dir->csumSeed, block, size) != tail->det_checksum){
+			mount->stats.checksumFailures++;
+			return TSX_INVALID_FORMAT;
+		}
+		mount->stats.checksumsVerified++;
+	}
+	ext_block_set_verified(mount, block);
+	return TSX_SUCCESS;
+}
+
+uint32_t ext_dentry_hash(uint32_t parent, char* name, size_t nameLen){
+	uint32_t hash = 2166136261 ^ parent;
+	for(size_t i = 0; i < nameLen; i++){
+		hash ^= (uint8_t) name[i];
+		hash *= 16777619;
+	}
+	return hash;
+}
+
+bool ext_dentry_lookup(ext_mount* mount, uint32_t parent, char* name, size_t nameLen, uint32_t* inode, uint8_t* type){
+	if(nameLen > EXT_DENTRY_NAME_MAX)
+		return FALSE;
+	uint32_t hash = ext_dentry_hash(parent, name, nameLen);
+	for(uint32_t index = ext_lru_first(&mount->dentryCache, hash); index != EXT_LRU_NONE; index = ext_lru_next(&mount->dentryCache, index)){
+		ext_dentry_cache_entry* entry = ext_lru_entry(&mount->dentryCache, index);
+		if(entry->link.hash != hash || entry->parent != parent || entry->nameLen != nameLen || memcmp(entry->name, name, nameLen) != 0)
+			continue;
+		ext_lru_touch(&mount->dentryCache, index);
+		if(entry->inode)
+			mount->stats.dentryCacheHits++;
+		else
+			mount->stats.dentryCacheNegativeHits++;
+		*inode = entry->inode;
+		*type = entry->type;
+		return TRUE;
+	}
+	mount->stats.dentryCacheMisses++;
+	return FALSE;
+}
+
+void ext_dentry_insert(ext_mount* mount, uint32_t parent, char* name, size_t nameLen, uint32_t inode, uint8_t type){
+	if(nameLen > EXT_DENTRY_NAME_MAX)
+		return;
+	uint32_t index = ext_lru_insert(&mount->dentryCache, ext_dentry_hash(parent, name, nameLen));
+	if(index == EXT_LRU_NONE)
+		return;
+	ext_dentry_cache_entry* entry = ext_lru_entry(&mount->dentryCache, index);
+	entry->parent = parent;
+	entry->inode = inode;
+	entry->type = type;
+	entry->nameLen = nameLen;
+	memcpy(entry->name, name, nameLen);
+}
+
+status_t ext_get_inode(ext_mount* mount, uint32_t inode, ext_inode* inodeData){
+	return ext_get_inode_raw(mount, inode, inodeData, NULL);
+}
+
+status_t ext_get_inode_raw(ext_mount* mount, uint32_t inode, ext_inode* inodeData, void* raw){ // raw receives the full on-disk inode (inodeSize bytes)
+	status_t status = 0;
+	size_t blockSize = mount->blockSize;
+	void* buf = NULL;
+	void* sectorBuf = NULL;
+	size_t sectorBufSize = 0;
+	void* cached = ext_inode_cache_find(mount, inode);
+	if(cached){
+		if(inodeData)
+			ext_copy_inode(mount, inodeData, cached);
+		if(raw)
+			memcpy(raw, cached, mount->inodeSize);
+		goto _end;
+	}
+	uint64_t block = 0;
+	size_t offset = 0;
+	status = ext_inode_location(mount, inode, &block, &offset);
+	CERROR();
+	void* inodeBuf = NULL;
+	if(mount->blockCache.capacity > 0){ // the rest of the block usually holds the inodes needed next
+		status = ext_block_get(mount, block, EXT_IO_INODE, &buf);
+		CERROR();
+		inodeBuf = buf + offset;
+	}else{ // without a cache to keep it in, only the sectors holding the inode are read
+		sectorBufSize = (offset % 512 + mount->inodeSize + 511) / 512 * 512;
+		sectorBuf = ext_scratch_alloc(mount, sectorBufSize);
+		if(!sectorBuf)
+			FERROR(TSX_OUT_OF_MEMORY);
+		status = ext_dev_read(mount, EXT_IO_INODE, mount->partStart + block * (blockSize / 512) + offset / 512, sectorBufSize / 512, (size_t) sectorBuf);
+		CERROR();
+		inodeBuf = sectorBuf + offset % 512;
+	}
+	// cached inodes have been verified already
+	if((mount->flags & 2) && !ext_inode_csum_verify(mount, inode, inodeBuf))
+		FERROR(TSX_INVALID_FORMAT);
+	uint32_t index = ext_lru_insert(&mount->inodeCache, inode);
+	if(index != EXT_LRU_NONE){
+		ext_inode_cache_entry* entry = ext_lru_entry(&mount->inodeCache, index);
+		entry->inode = inode;
+		memcpy(entry->data, inodeBuf, mount->inodeSize);
+	}
+	if(inodeData)
+		ext_copy_inode(mount, inodeData, inodeBuf);
+	if(raw)
+		memcpy(raw, inodeBuf, mount->inodeSize);
+	_end:
+	if(buf)
+		ext_block_put(mount, buf);
+	if(sectorBuf)
+		ext_scratch_free(mount, sectorBuf, sectorBufSize);
+	return status;
+}
+
+void* ext_inode_cache_find(ext_mount* mount, uint32_t inode){ // on-disk inode bytes if the inode is cached
+	for(uint32_t index = ext_lru_first(&mount->inodeCache, inode); index != EXT_LRU_NONE; index = ext_lru_next(&mount->inodeCache, index)){
+		ext_inode_cache_entry* entry = ext_lru_entry(&mount->inodeCache, index);
+		if(entry->inode != inode)
+			continue;
+		ext_lru_touch(&mount->inodeCache, index);
+		mount->stats.inodeCacheHits++;
+		return entry->data;
+	}
+	mount->stats.inodeCacheMisses++;
+	return NULL;
+}
+
+status_t ext_inode_location(ext_mount* mount, uint32_t inode, uint64_t* blockWrite, size_t* offsetWrite){ // inode table block containing the inode and the offset in it
+	status_t status = 0;
+	uint64_t inodeTable = 0;
+	if(inode == 0)
+		FERROR(TSX_INVALID_FORMAT);
+	status = ext_group_inode_table(mount, (inode - 1) / mount->sb.s_inodes_per_group, &inodeTable);
+	CERROR();
+	uint32_t inodeTableOff = ((inode - 1) % mount->sb.s_inodes_per_group) * mount->inodeSize;
+	*blockWrite = inodeTable + inodeTableOff / mount->blockSize;
+	*offsetWrite = inodeTableOff % mount->blockSize;
+	_end:
+	return status;
+}
+
+void ext_copy_inode(ext_mount* mount, ext_inode* dest, void* raw){
+	size_t size = MIN(mount->inodeSize, sizeof(ext_inode));
+	memcpy(dest, raw, size);
+	if(size < sizeof(ext_inode))
+		memset((void*) dest + size, 0, sizeof(ext_inode) - size);
+}
+
+status_t ext_file_open(ext_mount* mount, uint32_t inode, ext_file* file){
+	status_t status = 0;
+	void* raw = NULL;
+	memset(file, 0, sizeof(ext_file));
+	file->mount = mount;
+	file->inode = inode;
+	if(!(mount->sb.s_feature_incompat & EXT_INCOMPAT_INLINE_DATA)){
+		status = ext_get_inode(mount, inode, &file->inodeData);
+		ext_file_seed(file);
+		goto _end;
+	}
+	raw = ext_scratch_alloc(mount, mount->inodeSize);
+	if(!raw)
+		FERROR(TSX_OUT_OF_MEMORY);
+	status = ext_get_inode_raw(mount, inode, &file->inodeData, raw);
+	CERROR();
+	ext_file_seed(file);
+	if(file->inodeData.i_flags & EXT_INODE_INLINE_DATA_FL){
+		status = ext_inline_get(mount, raw, file);
+		CERROR();
+	}
+	_end:
+	if(raw)
+		ext_scratch_free(mount, raw, mount->inodeSize);
+	return status;
+}
+
+void ext_file_seed(ext_file* file){
+	if(!(file->mount->flags & 2))
+		return;
+	uint32_t crc = ext_crc32c(file->mount->csumSeed, &file->inode, 4);
+	file->csumSeed = ext_crc32c(crc, &file->inodeData.i_generation, 4);
+}
+
+void ext_file_close(ext_file* file){
+	if(file->cursor.leaf)
+		ext_scratch_free(file->mount, file->cursor.leaf, file->mount->blockSize);
+	memset(&file->cursor, 0, sizeof(ext_extent_cursor));
+	if(file->inlineData)
+		ext_kfree(file->inlineData, file->inlineSize);
+	file->inlineData = NULL;
+	file->inlineSize = 0;
+}
+
+status_t ext_inline_get(ext_mount* mount, void* raw, ext_file* file){ // copies i_block and the system.data attribute of an inline data inode
+	status_t status = 0;
+	ext_inode* inode = raw;
+	size_t iblockSize = sizeof(inode->i_blocks) + 12 /* i_block_i1 - i_block_i3 */;
+	void* value = NULL;
+	size_t valueSize = 0;
+	size_t ibodyStart = 128 + (mount->inodeSize > 128 ? inode->i_extra_isize : 0);
+	// in-inode extended attributes: magic, then entries up to a zero word, values are relative to the first entry
+	if(ibodyStart + 4 < mount->inodeSize && *((uint32_t*) (raw + ibodyStart)) == EXT_XATTR_MAGIC){
+		size_t entriesStart = ibodyStart + 4;
+		for(size_t off = entriesStart; off + sizeof(ext_xattr_entry) <= mount->inodeSize;){
+			ext_xattr_entry* entry = (ext_xattr_entry*) (raw + off);
+			if(*((uint32_t*) entry) == 0)
+				break;
+			if(entry->e_name_index == EXT_XATTR_INDEX_SYSTEM && entry->e_name_len == 4 && memcmp(entry->e_name, "data", 4) == 0){
+				if(entry->e_value_inum || entriesStart + entry->e_value_offs + entry->e_value_size > mount->inodeSize)
+					FERROR(TSX_INVALID_FORMAT);
+				value = raw + entriesStart + entry->e_value_offs;
+				valueSize = entry->e_value_size;
+				break;
+			}
+			off += (sizeof(ext_xattr_entry) + entry->e_name_len + 3) & ~3;
+		}
+	}
+	file->inlineSize = iblockSize + valueSize;
+	file->inlineData = ext_kmalloc(file->inlineSize);
+	if(!file->inlineData)
+		FERROR(TSX_OUT_OF_MEMORY);
+	memcpy(file->inlineData, inode->i_blocks, iblockSize);
+	if(valueSize)
+		memcpy(file->inlineData + iblockSize, value, valueSize);
+	_end:
+	return status;
+}
+
+status_t ext_read_inode_to(ext_file* file, void* location){ // writes exactly i_size bytes to location
+	uint64_t size = ext_inode_size(file->mount, &file->inodeData);
+	if(size > SIZE_MAX)
+		return TSX_TOO_LARGE;
+	return ext_read_inode_range(file, 0, size, location, NULL);
+}
+
+status_t ext_read_inode_range(ext_file* file, uint64_t offset, size_t length, void* dest, size_t* lengthWrite){
+	status_t status = 0;
+	ext_mount* mount = file->mount;
+	ext_run_list list;
+	memset(&list, 0, sizeof(ext_run_list));
+	list.mount = mount;
+	uint64_t size = ext_inode_size(mount, &file->inodeData);
+	if(offset > size)
+		offset = size;
+	if(length > size - offset)
+		length = size - offset;
+	if(lengthWrite)
+		*lengthWrite = length;
+	if(length == 0)
+		goto _end;
+	if(file->inlineData){
+		ext_read_inline(file, offset, length, dest);
+		goto _end;
+	}
+	// build the physical layout of the requested blocks first so that contiguous blocks can be read with a single command
+	status = ext_map_inode(file, offset / mount->blockSize, (offset + length + mount->blockSize - 1) / mount->blockSize, &list);
+	CERROR();
+	status = ext_read_runs(mount, &list, dest, offset, length, EXT_IO_DATA);
+	CERROR();
+	_end:
+	ext_run_list_free(&list);
+	return status;
+}
+
+status_t ext_read_inode_chunked(ext_file* file, uint64_t offset, uint64_t length, size_t chunkSize, ext_read_callback callback, void* arg){
+	status_t status = 0;
+	ext_mount* mount = file->mount;
+	ext_run_list list;
+	memset(&list, 0, sizeof(ext_run_list));
+	list.mount = mount;
+	void* buf = NULL;
+	size_t bufSize = 0;
+	uint64_t size = ext_inode_size(mount, &file->inodeData);
+	if(offset > size)
+		offset = size;
+	if(length > size - offset)
+		length = size - offset;
+	if(length == 0)
+		goto _end;
+	if(file->inlineData){ // small enough to be handed over in one piece
+		buf = ext_scratch_alloc(mount, length);
+		if(!buf)
+			FERROR(TSX_OUT_OF_MEMORY);
+		ext_read_inline(file, offset, length, buf);
+		status = callback(arg, offset, buf, length);
+		ext_scratch_free(mount, buf, length);
+		buf = NULL;
+		goto _end;
+	}
+	size_t blockSize = mount->blockSize;
+	chunkSize -= chunkSize % blockSize;
+	if(chunkSize == 0)
+		chunkSize = blockSize;
+	// one extra block holds the part of a block that belongs to the next chunk if offset is not block aligned;
+	// from the arena if this fits next to the cursor leaf, otherwise one heap buffer for the whole call
+	bufSize = chunkSize + blockSize;
+	buf = ext_scratch_alloc(mount, bufSize);
+	if(!buf)
+		FERROR(TSX_OUT_OF_MEMORY);
+	// every chunk is mapped and read on its own so that memory use does not depend on the file size, the extent
+	// cursor keeps remapping cheap. Device reads always cover whole blocks, buf holds file bytes from bufStart
+	// (block aligned) to bufStart + filled, so every block is read exactly once and nothing goes through a bounce block
+	uint64_t end = offset + length;
+	uint64_t bufStart = offset - offset % blockSize;
+	size_t filled = 0;
+	for(uint64_t pos = offset; pos < end;){
+		size_t chunkLength = MIN(chunkSize, end - pos);
+		uint64_t readStart = bufStart + filled;
+		uint64_t readEnd = (pos + chunkLength + blockSize - 1) / blockSize * blockSize;
+		if(readEnd > readStart){
+			list.count = 0;
+			status = ext_map_inode(file, readStart / blockSize, readEnd / blockSize, &list);
+			CERROR();
+			status = ext_read_runs(mount, &list, buf + filled, readStart, readEnd - readStart, EXT_IO_DATA);
+			CERROR();
+			filled += readEnd - readStart;
+		}
+		status = callback(arg, pos, buf + (pos - bufStart), chunkLength);
+		CERROR();
+		pos += chunkLength;
+		// keep the block pos is in if part of it was already read
+		uint64_t keepStart = pos - pos % blockSize;
+		size_t keep = bufStart + filled - keepStart;
+		if(keep > 0)
+			memmove(buf, buf + (keepStart - bufStart), keep);
+		bufStart = keepStart;
+		filled = keep;
+	}
+	_end:
+	ext_run_list_free(&list);
+	if(buf)
+		ext_scratch_free(mount, buf, bufSize);
+	return status;
+}
+
+void ext_read_inline(ext_file* file, uint64_t offset, size_t length, void* dest){ // bytes past the inline data read as zeros
+	size_t inlineLength = 0;
+	if(offset < file->inlineSize){
+		inlineLength = MIN(length, file->inlineSize - offset);
+		memcpy(dest, file->inlineData + offset, inlineLength);
+	}
+	if(inlineLength < length)
+		memset(dest + inlineLength, 0, length - inlineLength);
+}
+
+uint64_t ext_inode_size(ext_mount* mount, ext_inode* inode){
+	// the upper half used to be i_dir_acl for anything but regular files, directories only use it with LARGEDIR
+	if((inode->i_mode & EXT_S_IFMT) == EXT_S_IFREG || ((inode->i_mode & EXT_S_IFMT) == EXT_S_IFDIR && (mount->sb.s_feature_incompat & EXT_INCOMPAT_LARGEDIR)))
+		return inode->i_size_lo | ((uint64_t) inode->i_size_high << 32);
+	return inode->i_size_lo;
+}
+
+status_t ext_bmap(ext_file* file, uint64_t block, uint64_t* devBlockWrite){ // devBlock is 0 if the block is not allocated
+	ext_run run;
+	ext_run_list list;
+	list.runs = &run;
+	list.count = 0;
+	list.capacity = 1; // a single block always fits, so the list never allocates
+	list.mount = NULL;
+	status_t status = ext_map_inode(file, block, block + 1, &list);
+	*devBlockWrite = (status == TSX_SUCCESS && list.count > 0) ? run.devBlock : 0;
+	return status;
+}
+
+status_t ext_map_inode(ext_file* file, uint64_t startBlock, uint64_t endBlock, ext_run_list* list){ // maps file blocks [startBlock, endBlock)
+	status_t status = 0;
+	ext_inode* inode = &file->inodeData;
+	if(inode->i_flags & EXT_INODE_EXTENTS_FL){
+		status = ext_map_extent(file, startBlock, endBlock, list);
+		CERROR();
+	}else{
+		uint64_t fileBlock = 0;
+		for(int i = 0; i < 12 && fileBlock < endBlock; i++, fileBlock++){
+			if(fileBlock < startBlock)
+				continue;
+			if(!inode->i_blocks[i]) // hole
+				continue;
+			status = ext_run_list_add(list, fileBlock, inode->i_blocks[i], 1);
+			CERROR();
+		}
+		uint32_t indirect[3] = {inode->i_block_i1, inode->i_block_i2, inode->i_block_i3};
+		uint64_t span = file->mount->blockSize / 4;
+		for(int i = 0; i < 3 && fileBlock < endBlock; i++, span *= file->mount->blockSize / 4){
+			if(fileBlock + span <= startBlock){ // entirely before the requested range
+				fileBlock += span;
+				continue;
+			}
+			if(!indirect[i]){
+				fileBlock += span;
+				continue;
+			}
+			status = ext_map_indirect_blocks(file->mount, indirect[i], i, &fileBlock, startBlock, endBlock, list);
+			CERROR();
+		}
+	}
+	_end:
+	return status;
+}
+
+status_t ext_map_indirect_blocks(ext_mount* mount, uint32_t blockTable, uint32_t depth, uint64_t* fileBlock, uint64_t startBlock, uint64_t endBlock, ext_run_list* list){
+	status_t status = 0;
+	size_t blockSize = mount->blockSize;
+	uint32_t* table = NULL;
+	uint64_t span = 1; // file blocks covered by each table entry
+	for(uint32_t i = 0; i < depth; i++)
+		span *= blockSize / 4;
+	status = ext_block_get(mount, blockTable, EXT_IO_INDIRECT, (void**) &table);
+	CERROR();
+	for(int i = 0; i < blockSize / 4 && *fileBlock < endBlock; i++){
+		if(*fileBlock + span <= startBlock){
+			*fileBlock += span;
+			continue;
+		}
+		if(!table[i]){ // hole
+			*fileBlock += span;
+			continue;
+		}
+		if(depth == 0){
+			status = ext_run_list_add(list, *fileBlock, table[i], 1);
+			CERROR();
+			(*fileBlock)++;
+		}else{
+			status = ext_map_indirect_blocks(mount, table[i], depth - 1, fileBlock, startBlock, endBlock, list);
+			CERROR();
+		}
+	}
+	_end:
+	if(table)
+		ext_block_put(mount, table);
+	return status;
+}
+
+status_t ext_map_extent(ext_file* file, uint64_t startBlock, uint64_t endBlock, ext_run_list* list){
+	status_t status = 0;
+	uint64_t block = startBlock;
+	ext_extent_cursor* cursor = &file->cursor;
+	ext_extent_header* root = (ext_extent_header*) &file->inodeData.i_blocks[0];
+	// fetch the tree nodes covering a larger range in a few batches instead of one read per node,
+	// failures are ignored here since every node is read again when it is used
+	if(root->eh_depth > 0 && endBlock - startBlock > 1 && ext_extent_node_check(root, EXT_INODE_I_BLOCK_SIZE, root->eh_depth) &&
+		!(cursor->valid && startBlock >= cursor->start && endBlock <= cursor->end))
+		ext_extent_prefetch(file, startBlock, endBlock);
+	while(block < endBlock){
+		ext_extent_header* leaf = NULL;
+		status = ext_extent_find_leaf(file, block, &leaf);
+		CERROR();
+		ext_extent* extents = (ext_extent*) ((size_t) leaf + sizeof(ext_extent_header));
+		for(size_t i = ext_extent_search(leaf, block); i < leaf->eh_entries; i++){
+			uint64_t first = extents[i].ee_block;
+			uint64_t last = first + EXT_EXTENT_LENGTH(&extents[i]);
+			if(first >= endBlock)
+				break;
+			// unwritten extents read as zeros just like holes, so they are left out of the list
+			if(last <= startBlock || EXT_EXTENT_UNWRITTEN(&extents[i]))
+				continue;
+			uint64_t devBlock = extents[i].ee_start_lo | ((uint64_t) extents[i].ee_start_hi << 32);
+			if(first < startBlock){
+				devBlock += startBlock - first;
+				first = startBlock;
+			}
+			status = ext_run_list_add(list, first, devBlock, MIN(last, endBlock) - first);
+			CERROR();
+		}
+		if(file->cursor.end == EXT_BLOCK_END)
+			break;
+		if(file->cursor.end <= block) // cannot happen with sorted index entries, but must not loop forever
+			FERROR(TSX_INVALID_FORMAT);
+		block = file->cursor.end;
+	}
+	_end:
+	return status;
+}
+
+status_t ext_extent_prefetch(ext_file* file, uint64_t startBlock, uint64_t endBlock){ // loads the tree nodes covering [startBlock, endBlock) level by level
+	status_t status = 0;
+	ext_mount* mount = file->mount;
+	ext_extent_header* root = (ext_extent_header*) &file->inodeData.i_blocks[0];
+	size_t limit = mount->blockCache.capacity / 2;
+	uint64_t* nodes = NULL;
+	if(limit < 2)
+		goto _end;
+	nodes = ext_scratch_alloc(mount, limit * 3 * sizeof(uint64_t));
+	if(!nodes)
+		FERROR(TSX_OUT_OF_MEMORY);
+	uint64_t* level = nodes;
+	uint64_t* next = nodes + limit;
+	uint64_t* sorted = nodes + limit * 2;
+	size_t levelCount = ext_extent_collect(root, startBlock, endBlock, level, 0, limit);
+	for(uint16_t depth = root->eh_depth; depth > 0 && levelCount > 0; depth--){
+		memcpy(sorted, level, levelCount * sizeof(uint64_t));
+		status = ext_block_prefetch(mount, sorted, levelCount, EXT_IO_EXTENT);
+		CERROR();
+		if(depth == 1) // the prefetched nodes are leaves
+			break;
+		size_t nextCount = 0;
+		for(size_t i = 0; i < levelCount && nextCount < limit; i++){
+			ext_extent_header* node = NULL;
+			status = ext_block_get(mount, level[i], EXT_IO_EXTENT, (void**) &node);
+			CERROR();
+			if(ext_extent_node_check(node, mount->blockSize, depth - 1))
+				nextCount = ext_extent_collect(node, startBlock, endBlock, next, nextCount, limit);
+			ext_block_put(mount, node);
+		}
+		uint64_t* tmp = level;
+		level = next;
+		next = tmp;
+		levelCount = nextCount;
+	}
+	_end:
+	if(nodes)
+		ext_scratch_free(mount, nodes, limit * 3 * sizeof(uint64_t));
+	return status;
+}
+
+size_t ext_extent_collect(ext_extent_header* header, uint64_t startBlock, uint64_t endBlock, uint64_t* blocks, size_t count, size_t limit){ // appends the children of an index node overlapping the range
+	ext_extent_idx* idx = (ext_extent_idx*) ((size_t) header + sizeof(ext_extent_header));
+	for(size_t i = 0; i < header->eh_entries && count < limit; i++){
+		if(idx[i].ei_block >= endBlock)
+			break;
+		if(i + 1 < header->eh_entries && idx[i + 1].ei_block <= startBlock)
+			continue;
+		blocks[count++] = idx[i].ei_leaf_lo | ((uint64_t) idx[i].ei_leaf_hi << 32);
+	}
+	return count;
+}
+
+status_t ext_extent_find_leaf(ext_file* file, uint64_t block, ext_extent_header** leafWrite){
+	status_t status = 0;
+	ext_mount* mount = file->mount;
+	ext_extent_cursor* cursor = &file->cursor;
+	ext_extent_header* root = (ext_extent_header*) &file->inodeData.i_blocks[0];
+	void* node = NULL;
+	if(cursor->valid && block >= cursor->start && block < cursor->end){
+		mount->stats.extentCursorHits++;
+		goto _found;
+	}
+	mount->stats.extentTreeWalks++;
+	cursor->valid = FALSE;
+	uint64_t start = 0;
+	uint64_t end = EXT_BLOCK_END;
+	uint64_t nodeBlock = 0;
+	ext_extent_header* header = root;
+	if(header->eh_depth > EXT_EXTENT_MAX_DEPTH || !ext_extent_node_check(header, EXT_INODE_I_BLOCK_SIZE, header->eh_depth))
+		FERROR(TSX_INVALID_FORMAT);
+	while(header->eh_depth > 0){
+		if(header->eh_entries == 0)
+			FERROR(TSX_INVALID_FORMAT);
+		// binary search for the last index node starting at or before block
+		ext_extent_idx* idx = (ext_extent_idx*) ((size_t) header + sizeof(ext_extent_header));
+		size_t i = ext_extent_search(header, block);
+		if(idx[i].ei_block <= block)
+			start = MAX(start, idx[i].ei_block);
+		if(i + 1 < header->eh_entries)
+			end = MIN(end, idx[i + 1].ei_block);
+		uint16_t childDepth = header->eh_depth - 1;
+		nodeBlock = idx[i].ei_leaf_lo | ((uint64_t) idx[i].ei_leaf_hi << 32);
+		if(node)
+			ext_block_put(mount, node);
+		node = NULL;
+		status = ext_block_get(mount, nodeBlock, EXT_IO_EXTENT, &node);
+		CERROR();
+		header = node;
+		if(!ext_extent_node_check(header, mount->blockSize, childDepth))
+			FERROR(TSX_INVALID_FORMAT);
+		status = ext_extent_block_verify(file, node);
+		CERROR();
+	}
+	if(node){
+		if(!cursor->leaf){
+			cursor->leaf = ext_scratch_alloc(mount, mount->blockSize);
+			if(!cursor->leaf)
+				FERROR(TSX_OUT_OF_MEMORY);
+		}
+		memcpy(cursor->leaf, node, mount->blockSize);
+	}
+	cursor->leafBlock = nodeBlock;
+	cursor->start = start;
+	cursor->end = end;
+	cursor->valid = TRUE;
+	_found:
+	*leafWrite = root->eh_depth > 0 ? cursor->leaf : root;
+	_end:
+	if(node)
+		ext_block_put(mount, node);
+	return status;
+}
+
+status_t ext_extent_block_verify(ext_file* file, void* block){ // the checksum follows the last possible entry
+	ext_mount* mount = file->mount;
+	if(!(mount->flags & 2) || ext_block_verified(mount, block))
+		return TSX_SUCCESS;
+	size_t size = sizeof(ext_extent_header) + ((ext_extent_header*) block)->eh_max * sizeof(ext_extent);
+	if(size + 4 > mount->blockSize || ext_crc32c(file->csumSeed, block, size) != *((uint32_t*) (block + size))){
+		mount->stats.checksumFailures++;
+		return TSX_INVALID_FORMAT;
+	}
+	mount->stats.checksumsVerified++;
+	ext_block_set_verified(mount, block);
+	return TSX_SUCCESS;
+}
+
+bool ext_extent_node_check(ext_extent_header* header, size_t size, uint16_t depth){ // node must fit in size bytes and start the entries in strictly increasing order
+	if(header->eh_magic != EXT_INODE_EXTENT_HEADER_MAGIC || header->eh_depth != depth || header->eh_entries > header->eh_max)
+		return FALSE;
+	if(sizeof(ext_extent_header) + (size_t) header->eh_max * sizeof(ext_extent) > size)
+		return FALSE;
+	// ee_block of ext_extent and ei_block of ext_extent_idx are both the first field of 12-byte entries
+	uint32_t* entries = (uint32_t*) ((size_t) header + sizeof(ext_extent_header));
+	for(size_t i = 1; i < header->eh_entries; i++){
+		if(entries[i * 3] <= entries[(i - 1) * 3])
+			return FALSE;
+	}
+	return TRUE;
+}
+
+size_t ext_extent_search(ext_extent_header* header, uint64_t block){ // index of the last entry starting at or before block (0 if there is none)
+	// ee_block of ext_extent and ei_block of ext_extent_idx are both the first field of 12-byte entries
+	uint32_t* entries = (uint32_t*) ((size_t) header + sizeof(ext_extent_header));
+	size_t low = 0;
+	size_t high = header->eh_entries;
+	while(high - low > 1){
+		size_t mid = low + (high - low) / 2;
+		if(entries[mid * 3] <= block)
+			low = mid;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+void ext_crc32c_init(){
+	for(uint32_t i = 0; i < 256; i++){
+		uint32_t crc = i;
+		for(int j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (EXT_CRC32C_POLY & -(crc & 1));
+		ext_crc32c_table[0][i] = crc;
+	}
+	for(uint32_t i = 0; i < 256; i++){
+		for(int t = 1; t < 8; t++)
+			ext_crc32c_table[t][i] = (ext_crc32c_table[t - 1][i] >> 8) ^ ext_crc32c_table[0][ext_crc32c_table[t - 1][i] & 0xff];
+	}
+	ext_crc32c_ready = TRUE;
+}
+
+uint32_t ext_crc32c(uint32_t crc, void* data, size_t length){ // without the final inversion, as used by ext4
+	uint8_t* p = data;
+	if(!ext_crc32c_ready)
+		ext_crc32c_init();
+	while(length > 0 && ((size_t) p & 3)){
+		crc = ext_crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		length--;
+	}
+	// slicing-by-8: eight table lookups per eight bytes, no vector instructions needed
+	while(length >= 8){
+		uint32_t lo = *((uint32_t*) p) ^ crc;
+		uint32_t hi = *((uint32_t*) (p + 4));
+		crc = ext_crc32c_table[7][lo & 0xff] ^ ext_crc32c_table[6][(lo >> 8) & 0xff] ^
+			ext_crc32c_table[5][(lo >> 16) & 0xff] ^ ext_crc32c_table[4][lo >> 24] ^
+			ext_crc32c_table[3][hi & 0xff] ^ ext_crc32c_table[2][(hi >> 8) & 0xff] ^
+			ext_crc32c_table[1][(hi >> 16) & 0xff] ^ ext_crc32c_table[0][hi >> 24];
+		p += 8;
+		length -= 8;
+	}
+	while(length > 0){
+		crc = ext_crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		length--;
+	}
+	return crc;
+}
+
+bool ext_sb_csum_verify(ext_superblock* sb){
+	if(sb->s_checksum_type != 1 /* crc32c */)
+		return FALSE;
+	return ext_crc32c(0xffffffff, sb, offsetof(ext_superblock, s_checksum)) == sb->s_checksum;
+}
+
+bool ext_group_desc_csum_verify(ext_mount* mount, uint32_t group, ext_group_desc* desc){
+	size_t csumOffset = offsetof(ext_group_desc, bg_checksum);
+	uint16_t zero = 0;
+	uint32_t crc = ext_crc32c(mount->csumSeed, &group, 4);
+	crc = ext_crc32c(crc, desc, csumOffset);
+	crc = ext_crc32c(crc, &zero, 2);
+	if(mount->descSize > csumOffset + 2)
+		crc = ext_crc32c(crc, (void*) desc + csumOffset + 2, mount->descSize - csumOffset - 2);
+	if((crc & 0xffff) != desc->bg_checksum){
+		mount->stats.checksumFailures++;
+		return FALSE;
+	}
+	mount->stats.checksumsVerified++;
+	return TRUE;
+}
+
+bool ext_inode_csum_verify(ext_mount* mount, uint32_t inode, void* raw){
+	ext_inode* data = raw;
+	size_t loOffset = offsetof(ext_inode, i_osd2) + 8; // l_i_checksum_lo
+	size_t hiOffset = offsetof(ext_inode, i_checksum_hi);
+	uint16_t zero = 0;
+	bool hasHi = mount->inodeSize > 128 && 128 + data->i_extra_isize >= hiOffset + 2;
+	uint32_t crc = ext_crc32c(mount->csumSeed, &inode, 4);
+	crc = ext_crc32c(crc, &data->i_generation, 4);
+	crc = ext_crc32c(crc, raw, loOffset);
+	crc = ext_crc32c(crc, &zero, 2);
+	crc = ext_crc32c(crc, raw + loOffset + 2, 128 - loOffset - 2);
+	if(mount->inodeSize > 128){
+		crc = ext_crc32c(crc, raw + 128, hiOffset - 128);
+		size_t next = hiOffset;
+		if(hasHi){
+			crc = ext_crc32c(crc, &zero, 2);
+			next += 2;
+		}
+		crc = ext_crc32c(crc, raw + next, mount->inodeSize - next);
+	}
+	uint16_t lo = *((uint16_t*) (raw + loOffset));
+	bool valid = hasHi ? (crc == (lo | ((uint32_t) data->i_checksum_hi << 16))) : ((crc & 0xffff) == lo);
+	if(valid)
+		mount->stats.checksumsVerified++;
+	else
+		mount->stats.checksumFailures++;
+	return valid;
+}
+
+
+status_t ext_read_runs(ext_mount* mount, ext_run_list* list, void* dest, uint64_t offset, uint64_t length, uint8_t cause){ // dest receives file bytes [offset, offset + length)
 	status_t status = 0;
+	size_t blockSize = mount->blockSize;
+	size_t blockSecs = blockSize / 512;
+	uint64_t maxBlocks = EXT_MAX_TRANSFER_SECTORS / blockSecs;
+	uint64_t end = offset + length;
+	// DMA requires word alignment, otherwise every block goes through the bounce buffer
+	bool direct = (((size_t) dest - offset) & 1) == 0;
+	void* bounce = NULL;
+	uint64_t filled = offset;
+	for(size_t i = 0; i < list->count; i++){
+		ext_run* run = &list->runs[i];
+		uint64_t runStart = run->fileBlock * blockSize;
+		uint64_t runEnd = runStart + run->length * blockSize;
+		if(runEnd <= offset || runStart >= end)
+			continue;
+		// anything between two runs is a hole or unwritten
+		if(runStart > filled){
+			memset(dest + (filled - offset), 0, runStart - filled);
+			mount->stats.zeroFilledBytes += runStart - filled;
+		}
+		filled = MIN(runEnd, end);
+		// blocks of this run that are completely inside the requested range
+		uint64_t directStart = (MAX(runStart, offset) + blockSize - 1) / blockSize;
+		uint64_t directEnd = MIN(runEnd, end) / blockSize;
+		if(!direct || directStart > directEnd)
+			directStart = directEnd = run->fileBlock;
+		uint64_t block = MAX(runStart, offset) / blockSize;
+		uint64_t lastBlock = (MIN(runEnd, end) + blockSize - 1) / blockSize;
+		while(block < lastBlock){
+			uint64_t devLba = mount->partStart + (run->devBlock + block - run->fileBlock) * blockSecs;
+			if(block >= directStart && block < directEnd){
+				uint64_t blocks = MIN(maxBlocks, directEnd - block);
+				status = ext_dev_read(mount, cause, devLba, blocks * blockSecs, (size_t) dest + block * blockSize - offset);
+				CERROR();
+				block += blocks;
+				continue;
+			}
+			// partial block at either end of the range
+			if(!bounce){
+				bounce = ext_scratch_alloc(mount, blockSize);
+				if(!bounce)
+					FERROR(TSX_OUT_OF_MEMORY);
+			}
+			status = ext_dev_read(mount, cause, devLba, blockSecs, (size_t) bounce);
+			CERROR();
+			uint64_t copyStart = MAX(block * blockSize, offset);
+			uint64_t copyEnd = MIN((block + 1) * blockSize, end);
+			memcpy(dest + (copyStart - offset), bounce + (copyStart - block * blockSize), copyEnd - copyStart);
+			block++;
+		}
+	}
+	if(filled < end){
+		memset(dest + (filled - offset), 0, end - filled);
+		mount->stats.zeroFilledBytes += end - filled;
+	}
+	_end:
+	if(bounce)
+		ext_scratch_free(mount, bounce, blockSize);
+	return status;
+}
 
-	uint32_t cInode;
-	uint8_t cType;
-	status = ext_get_path_inode(driveLabel, partStart, path, &cInode, &cType);
-	CERROR();
 
-	if(cType != EXT_INODE_TYPE_FILE)
-		FERROR(TSX_NO_SUCH_FILE);
-	if(inode)
-		*inode = cInode;
+status_t ext_run_list_add(ext_run_list* list, uint64_t fileBlock, uint64_t devBlock, uint64_t length){ // merges with the previous run if contiguous
+	status_t status = 0;
+	if(list->count > 0){
+		ext_run* last = &list->runs[list->count - 1];
+		if(last->fileBlock + last->length == fileBlock && last->devBlock + last->length == devBlock){
+			last->length += length;
+			goto _end;
+		}
+	}
+	// an arena list that is still the last arena buffer grows in place, moving it would leave its old space unusable
+	// until the arena is empty
+	size_t newCapacity = list->capacity ? list->capacity * 2 : 16;
+	if(list->count >= list->capacity && list->mount && list->runs &&
+		ext_scratch_grow(list->mount, list->runs, list->capacity * sizeof(ext_run), newCapacity * sizeof(ext_run))){
+		list->capacity = newCapacity;
+	}else if(list->count >= list->capacity){
+		ext_run* runs = list->mount ? ext_scratch_alloc(list->mount, newCapacity * sizeof(ext_run)) : ext_kmalloc(newCapacity * sizeof(ext_run));
+		if(!runs)
+			FERROR(TSX_OUT_OF_MEMORY);
+		if(list->runs){
+			memcpy(runs, list->runs, list->count * sizeof(ext_run));
+			ext_run_list_release(list);
+		}
+		list->runs = runs;
+		list->capacity = newCapacity;
+	}
+	list->runs[list->count].fileBlock = fileBlock;
+	list->runs[list->count].devBlock = devBlock;
+	list->runs[list->count].length = length;
+	list->count++;
 	_end:
 	return status;
 }
 
-status_t ext_get_dir(char* driveLabel, uint64_t partStart, char* path, uint32_t* inode){
+void ext_run_list_free(ext_run_list* list){
+	if(list->runs)
+		ext_run_list_release(list);
+	memset(list, 0, sizeof(ext_run_list));
+}
+
+void ext_run_list_release(ext_run_list* list){ // frees the run array only
+	if(list->mount)
+		ext_scratch_free(list->mount, list->runs, list->capacity * sizeof(ext_run));
+	else
+		ext_kfree(list->runs, list->capacity * sizeof(ext_run));
+}
+
+
+status_t ext_file_map(ext_file* file, ext_file_run** runsWrite, size_t* countWrite){ // physical layout of the file, holes and unwritten extents are left out
 	status_t status = 0;
-	size_t pathlen = strlen(path) + 1;
-	char* pathcpy = kmalloc(pathlen);
-	if(!pathcpy)
-		FERROR(TSX_OUT_OF_MEMORY);
-	memcpy(pathcpy, path, pathlen);
-	pathcpy[pathlen] = 0;
-	for(size_t i = pathlen - 1; i > 0; i--){ // cut trailing file name ("/path/to/file" -> "/path/to/")
-		if(pathcpy[i] != '/')
-			pathcpy[i] = 0;
-		else
+	ext_mount* mount = file->mount;
+	ext_file_run* runs = NULL;
+	size_t count = 0;
+	ext_run_list list;
+	memset(&list, 0, sizeof(ext_run_list));
+	list.mount = mount;
+	if(file->inlineData) // stored in the inode, there are no blocks to point at
+		FERROR(TSX_UNSUPPORTED);
+	uint64_t size = ext_inode_size(mount, &file->inodeData);
+	status = ext_map_inode(file, 0, (size + mount->blockSize - 1) / mount->blockSize, &list);
+	CERROR();
+	if(list.count > 0){
+		runs = kmalloc(list.count * sizeof(ext_file_run));
+		if(!runs)
+			FERROR(TSX_OUT_OF_MEMORY);
+	}
+	size_t blockSecs = mount->blockSize / 512;
+	for(size_t i = 0; i < list.count; i++){
+		ext_run* run = &list.runs[i];
+		uint64_t offset = run->fileBlock * mount->blockSize;
+		if(offset >= size)
 			break;
+		// blocks past the end of the file are not part of the layout
+		uint64_t length = MIN(run->length * mount->blockSize, size - offset);
+		runs[count].lba = mount->partStart + run->devBlock * blockSecs;
+		runs[count].sectors = (length + 511) / 512;
+		runs[count].offset = offset;
+		count++;
 	}
-	uint32_t cInode;
-	uint8_t cType;
-	status = ext_get_path_inode(driveLabel, partStart, pathcpy, &cInode, &cType);
-	kfree(pathcpy, pathlen);
+	*runsWrite = runs;
+	*countWrite = count;
+	runs = NULL;
+	_end:
+	if(runs)
+		kfree(runs, list.count * sizeof(ext_file_run));
+	ext_run_list_free(&list);
+	return status;
+}
+
+status_t ext_batch_add_file(ext_mount* mount, ext_batch* batch, size_t index, char* path, void* dest){ // zero-fills holes now and queues reads for the rest of the file
+	status_t status = 0;
+	uint32_t inode = 0;
+	ext_file file;
+	memset(&file, 0, sizeof(ext_file));
+	ext_run_list list;
+	memset(&list, 0, sizeof(ext_run_list));
+	list.mount = mount;
+	status = ext_get_file(mount, path, &inode);
 	CERROR();
-	if(cType != EXT_INODE_TYPE_DIRECTORY)
-		FERROR(TSX_NO_SUCH_DIRECTORY);
-	if(inode)
-		*inode = cInode;
+	status = ext_file_open(mount, inode, &file);
+	CERROR();
+	uint64_t size = ext_inode_size(mount, &file.inodeData);
+	if(size > SIZE_MAX)
+		FERROR(TSX_TOO_LARGE);
+	if(file.inlineData || ((size_t) dest & 1)){ // nothing to batch, or DMA is not possible anyway
+		status = ext_read_inode_to(&file, dest);
+		goto _end;
+	}
+	size_t blockSize = mount->blockSize;
+	size_t blockSecs = blockSize / 512;
+	status = ext_map_inode(&file, 0, (size + blockSize - 1) / blockSize, &list);
+	CERROR();
+	uint64_t filled = 0;
+	for(size_t i = 0; i < list.count; i++){
+		ext_run* run = &list.runs[i];
+		uint64_t runStart = run->fileBlock * blockSize;
+		uint64_t runEnd = MIN(runStart + run->length * blockSize, size);
+		if(runStart >= size)
+			break;
+		if(runStart > filled){
+			memset(dest + filled, 0, runStart - filled);
+			mount->stats.zeroFilledBytes += runStart - filled;
+		}
+		filled = runEnd;
+		uint64_t lba = mount->partStart + run->devBlock * blockSecs;
+		size_t fullBlocks = (runEnd - runStart) / blockSize;
+		if(fullBlocks > 0){
+			status = ext_batch_add(batch, lba, fullBlocks * blockSecs, dest + runStart, fullBlocks * blockSize, index);
+			CERROR();
+		}
+		if(runEnd - runStart > fullBlocks * blockSize){ // the last block of the file is only partially copied
+			status = ext_batch_add(batch, lba + fullBlocks * blockSecs, blockSecs, dest + runStart + fullBlocks * blockSize,
+				runEnd - runStart - fullBlocks * blockSize, index);
+			CERROR();
+		}
+	}
+	if(filled < size){
+		memset(dest + filled, 0, size - filled);
+		mount->stats.zeroFilledBytes += size - filled;
+	}
 	_end:
+	if(file.mount)
+		ext_file_close(&file);
+	ext_run_list_free(&list);
 	return status;
 }
 
-status_t ext_get_path_inode(char* driveLabel, uint64_t partStart, char* path, uint32_t* inode, uint8_t* type){
+status_t ext_batch_add(ext_batch* batch, uint64_t lba, size_t sectors, void* dest, size_t length, size_t file){
 	status_t status = 0;
-	uint32_t cInode = 2 /* root inode */;
-	uint8_t cType = EXT_INODE_TYPE_DIRECTORY;
-	ext_inode dirNode;
+	if(batch->count >= batch->capacity){
+		size_t newCapacity = batch->capacity ? batch->capacity * 2 : 16;
+		ext_batch_read* reads = ext_kmalloc(newCapacity * sizeof(ext_batch_read));
+		if(!reads)
+			FERROR(TSX_OUT_OF_MEMORY);
+		if(batch->reads){
+			memcpy(reads, batch->reads, batch->count * sizeof(ext_batch_read));
+			ext_kfree(batch->reads, batch->capacity * sizeof(ext_batch_read));
+		}
+		batch->reads = reads;
+		batch->capacity = newCapacity;
+	}
+	ext_batch_read* read = &batch->reads[batch->count++];
+	read->lba = lba;
+	read->sectors = sectors;
+	read->dest = dest;
+	read->length = length;
+	read->file = file;
+	_end:
+	return status;
+}
 
-	path++;
-	size_t parts = util_count_parts(path, '/');
-	bool found = FALSE;
-	for(int i = 0; i < parts; i++){
-		if(!*path)
-			break;
-		size_t pathpartlen = 0;
-		while(!(path[pathpartlen] == '/' || path[pathpartlen] == 0))
-			pathpartlen++;
-		status = ext_get_inode(driveLabel, partStart, cInode, &dirNode);
-		CERROR();
-		ext_dir_entry* dirEntry = NULL;
-		size_t dirTableSize = 0;
-		size_t dirTableSizeAbs = 0;
-		status = ext_read_inode(driveLabel, partStart, &dirNode, (void**) &dirEntry, &dirTableSize, &dirTableSizeAbs);
-		CERROR();
-		ext_dir_entry* startEntry = dirEntry;
-		while(1){
-			if((i < parts - 1 ? (dirEntry->file_type == EXT_INODE_TYPE_DIRECTORY) : true) && pathpartlen == 
-				dirEntry->name_len && strncmp(dirEntry->name, path, dirEntry->name_len) == 0){
-				found = TRUE;
+void ext_batch_sort(ext_batch_read* reads, size_t count){ // shell sort by LBA
+	for(size_t gap = count / 2; gap > 0; gap /= 2){
+		for(size_t i = gap; i < count; i++){
+			ext_batch_read tmp = reads[i];
+			size_t j = i;
+			for(; j >= gap && reads[j - gap].lba > tmp.lba; j -= gap)
+				reads[j] = reads[j - gap];
+			reads[j] = tmp;
+		}
+	}
+}
+
+void ext_batch_run(ext_mount* mount, ext_batch* batch, status_t* statuses){ // batch must be sorted, a failed read fails every file it covers
+	void* bounce = NULL;
+	ext_batch_read* reads = batch->reads;
+	for(size_t i = 0; i < batch->count;){
+		ext_batch_read* first = &reads[i];
+		// extend the command over following reads that continue on disk; reads that also continue in memory go directly
+		// to the destination, anything else is collected in the bounce buffer
+		size_t sectors = first->sectors;
+		bool direct = first->length == first->sectors * 512;
+		size_t end = i + 1;
+		for(; end < batch->count; end++){
+			ext_batch_read* read = &reads[end];
+			if(read->lba != first->lba + sectors)
 				break;
-			}
-			dirEntry = (ext_dir_entry*) ((size_t) dirEntry + dirEntry->rec_len);
-			if((size_t) dirEntry >= (size_t) startEntry + dirTableSize || dirEntry->rec_len == 0){
+			bool nextDirect = direct && read->length == read->sectors * 512 && read->dest == reads[end - 1].dest + reads[end - 1].length;
+			if(!nextDirect && (sectors + read->sectors) * 512 > EXT_BATCH_BOUNCE_SIZE)
 				break;
-			}
+			direct = nextDirect;
+			sectors += read->sectors;
 		}
-		if(found){
-			cInode = dirEntry->inode;
-			cType = dirEntry->file_type;
+		status_t status = 0;
+		if(direct){
+			for(size_t done = 0; done < sectors;){
+				size_t count = MIN(sectors - done, EXT_MAX_TRANSFER_SECTORS);
+				status = ext_dev_read(mount, EXT_IO_DATA, first->lba + done, count, (size_t) first->dest + done * 512);
+				if(status != TSX_SUCCESS)
+					break;
+				done += count;
+			}
+		}else{
+			if(!bounce)
+				bounce = ext_scratch_alloc(mount, EXT_BATCH_BOUNCE_SIZE);
+			if(!bounce)
+				status = TSX_OUT_OF_MEMORY;
+			else
+				status = ext_dev_read(mount, EXT_IO_DATA, first->lba, sectors, (size_t) bounce);
+			for(size_t j = i; j < end && status == TSX_SUCCESS; j++)
+				memcpy(reads[j].dest, bounce + (reads[j].lba - first->lba) * 512, reads[j].length);
 		}
-		kfree_aligned(startEntry, dirTableSizeAbs);
-		if(!found){
-			FERROR(i == parts - 1 ? TSX_NO_SUCH_FILE : TSX_NO_SUCH_DIRECTORY);
+		for(size_t j = i; j < end && status != TSX_SUCCESS; j++){
+			if(statuses[reads[j].file] == TSX_SUCCESS)
+				statuses[reads[j].file] = status;
 		}
-		path = util_str_cut_to(path, '/') + 1;
-		found = FALSE;
+		mount->stats.batchReads++;
+		i = end;
 	}
+	if(bounce)
+		ext_scratch_free(mount, bounce, EXT_BATCH_BOUNCE_SIZE);
+}
 
-	if(inode)
-		*inode = cInode;
-	if(type)
-		*type = cType;
-	_end:
-	return status;
+void ext_batch_free(ext_batch* batch){
+	if(batch->reads)
+		ext_kfree(batch->reads, batch->capacity * sizeof(ext_batch_read));
+	memset(batch, 0, sizeof(ext_batch));
 }
 
-status_t ext_get_inode(char* driveLabel, uint64_t partStart, uint32_t inode, ext_inode* inodeData){
-	status_t status = 0;
-	ext_superblock* sb = kmalloc_aligned(4096);
-	if(!sb)
-		FERROR(TSX_OUT_OF_MEMORY);
-	ext_group_desc* gd = NULL;
-	void* buf = NULL;
-	status = msio_read_drive(driveLabel, partStart + 2, 4, (size_t) sb);
-	CERROR();
-	size_t blockSize = util_math_pow(2, 10 + sb->s_log_block_size);
-	uint32_t bg = (inode - 1) / sb->s_inodes_per_group;
-	uint32_t blockGroups = sb->s_inodes_count / sb->s_inodes_per_group;
-	uint32_t blockGroupsLen = blockGroups * ((sb->s_feature_incompat & EXT_INCOMPAT_64BIT) ? sb->s_desc_size : 32);
-	if(blockGroupsLen % 512 != 0)
-		blockGroupsLen += 512 - (blockGroupsLen % 512);
 
-	gd = kmalloc_aligned(blockGroupsLen);
-	if(!gd)
-		FERROR(TSX_OUT_OF_MEMORY);
-	status = msio_read_drive(driveLabel, partStart + MAX(blockSize, 2048 /* padding + super block */) / 512, blockGroupsLen / 512, (size_t) gd);
-	CERROR();
-	ext_group_desc* blockGroup = (ext_group_desc*) ((size_t) gd + bg * ((sb->s_feature_incompat & EXT_INCOMPAT_64BIT) ? sb->s_desc_size : 32));
-	uint64_t inodeTable = blockGroup->bg_inode_table_lo;
-	if((sb->s_feature_incompat & EXT_INCOMPAT_64BIT) && sb->s_desc_size > 32)
-		inodeTable |= ((uint64_t) blockGroup->bg_inode_table_hi) << 32;
-	uint32_t inodeTableOff = ((inode - 1) % sb->s_inodes_per_group) * (sb->s_rev_level > 0 ? sb->s_inode_size : 128);
-	uint64_t lba = (inodeTableOff - inodeTableOff % blockSize + inodeTable * blockSize) / 512 + partStart;
-	buf = kmalloc_aligned(blockSize);
-	if(!buf)
-		FERROR(TSX_OUT_OF_MEMORY);
-	status = msio_read_drive(driveLabel, lba, blockSize / 512, (size_t) buf);
-	CERROR();
-	ext_inode* inodeBuf = buf + inodeTableOff % blockSize;
-	if(inodeData)
-		memcpy(inodeData, inodeBuf, sizeof(ext_inode));
+void ext_plan_load(ext_mount* mount){ // enables the boot plan if the plan file exists and is usable
+	uint32_t inode = 0;
+	ext_file file;
+	memset(&file, 0, sizeof(ext_file));
+	mount->flags |= 4;
+	if(!EXT_BOOT_PLAN)
+		goto _end;
+	if(ext_get_file(mount, EXT_BOOT_PLAN_PATH, &inode) != TSX_SUCCESS && ext_get_file(mount, EXT_BOOT_PLAN_ROOT_PATH, &inode) != TSX_SUCCESS)
+		goto _end;
+	if(ext_file_open(mount, inode, &file) != TSX_SUCCESS)
+		goto _end;
+	uint64_t size = ext_inode_size(mount, &file.inodeData);
+	if(file.inlineData || size < EXT_BOOT_PLAN_MIN_SIZE || size > EXT_BOOT_PLAN_MAX_SIZE || size % 512 != 0)
+		goto _end;
+	// the plan is written back in place, so every byte of the file must be backed by a written block
+	if(ext_map_inode(&file, 0, (size + mount->blockSize - 1) / mount->blockSize, &mount->planRuns) != TSX_SUCCESS)
+		goto _end;
+	uint64_t covered = 0;
+	for(size_t i = 0; i < mount->planRuns.count; i++){
+		if(mount->planRuns.runs[i].fileBlock * mount->blockSize != covered)
+			break;
+		covered += mount->planRuns.runs[i].length * mount->blockSize;
+	}
+	if(covered < size)
+		goto _end;
+	mount->plan = ext_kmalloc_aligned(size);
+	if(!mount->plan)
+		goto _end;
+	mount->planSize = size;
+	if(ext_read_runs(mount, &mount->planRuns, mount->plan, 0, size, EXT_IO_PLAN) != TSX_SUCCESS)
+		goto _end;
+	ext_plan_header* header = mount->plan;
+	// entries are checked one by one against their inode when they are used, so mounting the filesystem elsewhere
+	// (which changes s_wtime) does not invalidate the plan
+	if(!ext_plan_check(header, size)){
+		// never written or damaged, start over
+		memset(header, 0, sizeof(ext_plan_header));
+		header->magic = EXT_BOOT_PLAN_MAGIC;
+		header->version = EXT_BOOT_PLAN_VERSION;
+		header->length = sizeof(ext_plan_header);
+	}
+	reloc_ptr((void**) &mount->plan);
+	reloc_ptr((void**) &mount->planRuns.runs);
+	mount->flags |= 8;
 	_end:
-	if(sb)
-		kfree_aligned(sb, 4096);
-	if(gd)
-		kfree_aligned(gd, blockGroupsLen);
-	if(buf)
-		kfree_aligned(buf, blockSize);
-	return status;
+	if(file.mount)
+		ext_file_close(&file);
+	if(!(mount->flags & 8)){
+		if(mount->plan)
+			ext_kfree_aligned(mount->plan, mount->planSize);
+		mount->plan = NULL;
+		mount->planSize = 0;
+		ext_run_list_free(&mount->planRuns);
+	}
+}
+
+void ext_plan_free(ext_mount* mount){
+	if(!(mount->flags & 8))
+		return;
+	del_reloc_ptr((void**) &mount->plan);
+	del_reloc_ptr((void**) &mount->planRuns.runs);
+	ext_kfree_aligned(mount->plan, mount->planSize);
+	ext_run_list_free(&mount->planRuns);
+	mount->plan = NULL;
+	mount->planSize = 0;
+	mount->flags &= ~8;
+}
+
+bool ext_plan_writable(ext_mount* mount){ // the plan is not updated if the journal needs to be replayed or the filesystem was not unmounted cleanly
+	if(mount->sb.s_feature_incompat & EXT_INCOMPAT_RECOVER)
+		return FALSE;
+	return (mount->sb.s_state & EXT_STATE_VALID) && !(mount->sb.s_state & EXT_STATE_ERROR);
+}
+
+bool ext_plan_check(ext_plan_header* header, size_t size){ // TRUE if every entry of the plan lies within the used part of the plan
+	if(header->magic != EXT_BOOT_PLAN_MAGIC || header->version != EXT_BOOT_PLAN_VERSION || header->length < sizeof(ext_plan_header) ||
+		header->length > size || header->checksum != ext_crc32c(0xffffffff, (void*) header + 12, header->length - 12))
+		return FALSE;
+	size_t entries = 0;
+	for(size_t off = sizeof(ext_plan_header); off < header->length; entries++){
+		ext_plan_entry* entry = (void*) header + off;
+		if(header->length - off < sizeof(ext_plan_entry) || entry->length > header->length - off ||
+			entry->length < sizeof(ext_plan_entry) + EXT_BOOT_PLAN_PATH_SIZE((size_t) entry->pathLen) + (uint64_t) entry->runCount * sizeof(ext_run))
+			return FALSE;
+		off += entry->length;
+	}
+	return entries == header->entries;
+}
+
+ext_plan_entry* ext_plan_find(ext_mount* mount, char* path){ // NULL if the path has no entry or the file changed since it was recorded
+	if(!(mount->flags & 4))
+		ext_plan_load(mount);
+	if(!(mount->flags & 8))
+		return NULL;
+	ext_plan_header* header = mount->plan;
+	size_t pathLen = strlen(path);
+	// the entry lengths were checked by ext_plan_load and are kept consistent by ext_plan_record
+	for(size_t off = sizeof(ext_plan_header); off < header->length;){
+		ext_plan_entry* entry = mount->plan + off;
+		off += entry->length;
+		if(entry->pathLen != pathLen || memcmp(entry->path, path, pathLen) != 0)
+			continue;
+		// the inode is usually already cached, this replaces the path walk and the block mapping
+		ext_inode inodeData;
+		if(ext_get_inode(mount, entry->inode, &inodeData) != TSX_SUCCESS || inodeData.i_generation != entry->generation ||
+			inodeData.i_mtime != entry->mtime || ext_inode_size(mount, &inodeData) != entry->size)
+			break;
+		mount->stats.planHits++;
+		return entry;
+	}
+	mount->stats.planMisses++;
+	return NULL;
+}
+
+status_t ext_plan_read(ext_mount* mount, ext_plan_entry* entry, void* dest){
+	if(entry->size > SIZE_MAX)
+		return TSX_TOO_LARGE;
+	ext_run_list list;
+	list.runs = (ext_run*) (entry->path + EXT_BOOT_PLAN_PATH_SIZE(entry->pathLen));
+	list.count = entry->runCount;
+	list.capacity = entry->runCount;
+	list.mount = NULL;
+	return ext_read_runs(mount, &list, dest, 0, entry->size, EXT_IO_DATA);
 }
 
-status_t ext_read_inode(char* driveLabel, uint64_t partStart, ext_inode* inode, void** location, size_t* size, size_t* absSizeWrite){
+status_t ext_plan_record(ext_mount* mount, char* path, ext_file* file){ // replaces the entry of path with the current layout of file
 	status_t status = 0;
-	ext_superblock* sb = kmalloc_aligned(4096);
-	if(!sb)
-		FERROR(TSX_OUT_OF_MEMORY);
-	void* loc = NULL;
-	status = msio_read_drive(driveLabel, partStart + 2, 4, (size_t) sb);
+	ext_run_list list;
+	memset(&list, 0, sizeof(ext_run_list));
+	list.mount = mount;
+	if(!(mount->flags & 8) || file->inlineData || !ext_plan_writable(mount))
+		goto _end;
+	ext_plan_header* header = mount->plan;
+	size_t pathLen = strlen(path);
+	if(pathLen > 0xffff)
+		FERROR(TSX_TOO_LARGE);
+	uint64_t size = ext_inode_size(mount, &file->inodeData);
+	status = ext_map_inode(file, 0, (size + mount->blockSize - 1) / mount->blockSize, &list);
 	CERROR();
-	size_t blockSize = util_math_pow(2, 10 + sb->s_log_block_size);
-	if(inode->i_size_high)
+	size_t entryLength = sizeof(ext_plan_entry) + EXT_BOOT_PLAN_PATH_SIZE(pathLen) + list.count * sizeof(ext_run);
+	size_t changed = header->length;
+	bool removed = FALSE;
+	for(size_t off = sizeof(ext_plan_header); off < header->length;){
+		ext_plan_entry* entry = mount->plan + off;
+		if(entry->pathLen == pathLen && memcmp(entry->path, path, pathLen) == 0){
+			size_t oldLength = entry->length;
+			memmove(mount->plan + off, mount->plan + off + oldLength, header->length - off - oldLength);
+			header->length -= oldLength;
+			header->entries--;
+			changed = off;
+			removed = TRUE;
+			break;
+		}
+		off += entry->length;
+	}
+	bool fits = header->length + entryLength <= mount->planSize;
+	if(!fits && !removed)
 		FERROR(TSX_TOO_LARGE);
-	size_t absSize = inode->i_size_lo;
-	if(absSize % blockSize != 0)
-		absSize += blockSize - (absSize % blockSize);
-	loc = kmalloc_aligned(absSize);
-	if(!loc)
-		FERROR(TSX_OUT_OF_MEMORY);
-	*location = loc;
-	*size = inode->i_size_lo;
-	if(absSizeWrite)
-		*absSizeWrite = absSize;
-	status = ext_read_inode_to(driveLabel, partStart, inode, loc);
+	if(fits){
+		ext_plan_entry* entry = mount->plan + header->length;
+		entry->length = entryLength;
+		entry->inode = file->inode;
+		entry->generation = file->inodeData.i_generation;
+		entry->mtime = file->inodeData.i_mtime;
+		entry->size = size;
+		entry->pathLen = pathLen;
+		entry->reserved = 0;
+		entry->runCount = list.count;
+		memset(entry->path, 0, EXT_BOOT_PLAN_PATH_SIZE(pathLen));
+		memcpy(entry->path, path, pathLen);
+		memcpy(entry->path + EXT_BOOT_PLAN_PATH_SIZE(pathLen), list.runs, list.count * sizeof(ext_run));
+		header->length += entryLength;
+		header->entries++;
+	}
+	status = ext_plan_write(mount, changed);
 	CERROR();
+	if(!fits)
+		FERROR(TSX_TOO_LARGE);
 	_end:
-	if(sb)
-		kfree_aligned(sb, 4096);
-	if(loc && status != TSX_SUCCESS)
-		kfree_aligned(loc, absSize);
+	ext_run_list_free(&list);
 	return status;
 }
 
-status_t ext_read_inode_to(char* driveLabel, uint64_t partStart, ext_inode* inode, void* location){
+status_t ext_plan_write(ext_mount* mount, size_t changed){ // writes the header and everything from changed to the end back to the plan file
 	status_t status = 0;
-	ext_superblock* sb = kmalloc_aligned(4096);
-	if(!sb)
-		FERROR(TSX_OUT_OF_MEMORY);
-	status = msio_read_drive(driveLabel, partStart + 2, 4, (size_t) sb);
-	CERROR();
-	size_t blockSize = util_math_pow(2, 10 + sb->s_log_block_size);
-	kfree_aligned(sb, 4096);
-	if(inode->i_flags & EXT_INODE_EXTENTS_FL){
-		ext_extent_header* header = (ext_extent_header*) &inode->i_blocks[0];
-		status = ext_read_extent(driveLabel, partStart, header, blockSize, location);
-		CERROR();
-	}else{
-		for(int i = 0; i < 12; i++){
-			if(!inode->i_blocks[i])
-				break;
-			uint64_t lba = inode->i_blocks[i] * blockSize / 512 + partStart;
-			status = msio_read_drive(driveLabel, lba, blockSize / 512, (size_t) location);
-			CERROR();
-			location += blockSize;
-		}
-		if(inode->i_block_i1){
-			status = ext_read_indirect_blocks(driveLabel, partStart, blockSize, inode->i_block_i1, 0, &location);
-			CERROR();
-		}
-		if(inode->i_block_i2){
-			status = ext_read_indirect_blocks(driveLabel, partStart, blockSize, inode->i_block_i2, 1, &location);
-			CERROR();
-		}
-		if(inode->i_block_i3){
-			status = ext_read_indirect_blocks(driveLabel, partStart, blockSize, inode->i_block_i3, 2, &location);
-			CERROR();
+	ext_plan_header* header = mount->plan;
+	header->checksum = ext_crc32c(0xffffffff, mount->plan + 12, header->length - 12);
+	size_t blockSecs = mount->blockSize / 512;
+	uint64_t firstSector = changed / 512;
+	uint64_t endSector = (header->length + 511) / 512;
+	if(firstSector > endSector) // entries were only removed
+		firstSector = endSector;
+	for(size_t i = 0; i < mount->planRuns.count; i++){
+		ext_run* run = &mount->planRuns.runs[i];
+		uint64_t runStart = run->fileBlock * blockSecs;
+		uint64_t runEnd = runStart + run->length * blockSecs;
+		// sector 0 holds the header and always changes
+		uint64_t ranges[2][2] = {{0, 1}, {MAX(firstSector, 1), endSector}};
+		for(size_t r = 0; r < 2; r++){
+			uint64_t start = MAX(ranges[r][0], runStart);
+			uint64_t end = MIN(ranges[r][1], runEnd);
+			while(start < end){
+				uint64_t count = MIN(end - start, EXT_MAX_TRANSFER_SECTORS);
+				status = ext_dev_write(mount, mount->partStart + run->devBlock * blockSecs + (start - runStart), count,
+					(size_t) mount->plan + start * 512);
+				CERROR();
+				mount->stats.planWrites++;
+				start += count;
+			}
 		}
 	}
 	_end:
+	if(status != TSX_SUCCESS) // do not keep writing to a device that refuses it
+		ext_plan_free(mount);
 	return status;
 }
 
-status_t ext_read_indirect_blocks(char* driveLabel, uint64_t partStart, uint32_t blockSize, uint32_t blockTable, uint32_t depth, void** writeLoc){
+
+status_t ext_read_dir_plus(ext_file* dir, list_array** listWrite){
 	status_t status = 0;
-	uint32_t* table = kmalloc_aligned(blockSize);
-	if(!table)
+	list_array* list = list_array_create(0);
+	if(!list)
 		FERROR(TSX_OUT_OF_MEMORY);
-	status = msio_read_drive(driveLabel, blockTable * blockSize / 512 + partStart, blockSize / 512, (size_t) table);
+	status = ext_dir_iterate(dir, ext_dir_plus_add, list);
 	CERROR();
-	if(depth == 0){
-		for(int i = 0; i < blockSize / 4; i++){
-			if(!table[i])
-				break;
-			uint64_t lba = table[i] * blockSize / 512 + partStart;
-			status = msio_read_drive(driveLabel, lba, blockSize / 512, (size_t) *writeLoc);
-			CERROR();
-			*writeLoc += blockSize;
-		}
-	}else{
-		for(int i = 0; i < blockSize / 4; i++){
-			if(!table[i])
-				break;
-			status = ext_read_indirect_blocks(driveLabel, partStart, blockSize, table[i], depth - 1, writeLoc);
-			CERROR();
+	status = ext_dir_info_fill(dir->mount, list);
+	CERROR();
+	*listWrite = list;
+	list = NULL;
+	_end:
+	if(list){
+		for(size_t i = 0; i < list->length; i++){
+			ext_dir_info* info = list_array_get(list, i);
+			kfree(info, sizeof(ext_dir_info) + info->nameLen + 1);
 		}
+		list_array_delete(list);
 	}
-	_end:
-	if(table)
-		kfree_aligned(table, blockSize);
 	return status;
 }
 
-status_t ext_read_extent(char* driveLabel, uint64_t partStart, ext_extent_header* header, size_t blockSize, void* destLocation){
+status_t ext_dir_plus_add(void* arg, uint32_t inode, uint8_t type, char* name, size_t nameLen){
+	ext_dir_info* info = kmalloc(sizeof(ext_dir_info) + nameLen + 1);
+	if(!info)
+		return TSX_OUT_OF_MEMORY;
+	info->inode = inode;
+	info->type = type;
+	info->nameLen = nameLen;
+	info->size = 0;
+	memcpy(info->name, name, nameLen);
+	info->name[nameLen] = 0;
+	status_t status = list_array_push((list_array*) arg, info);
+	if(status != TSX_SUCCESS)
+		kfree(info, sizeof(ext_dir_info) + nameLen + 1);
+	return status;
+}
+
+status_t ext_dir_info_fill(ext_mount* mount, list_array* list){ // reads the size of every entry, visiting the inodes in inode table order
 	status_t status = 0;
-	void* tempData = kmalloc_aligned(blockSize);
-	if(!tempData)
+	size_t count = list->length;
+	size_t limit = MAX(mount->blockCache.capacity / 2, 1);
+	uint64_t* keys = NULL;
+	uint64_t* blocks = NULL;
+	if(count == 0)
+		goto _end;
+	keys = ext_scratch_alloc(mount, count * sizeof(uint64_t));
+	blocks = ext_scratch_alloc(mount, limit * sizeof(uint64_t));
+	if(!keys || !blocks)
 		FERROR(TSX_OUT_OF_MEMORY);
-	if(header->eh_magic != EXT_INODE_EXTENT_HEADER_MAGIC)
-		FERROR(TSX_INVALID_FORMAT);
-	if(header->eh_depth == 0){
-		ext_extent* extents = (ext_extent*) ((size_t) header + sizeof(ext_extent_header));
-		for(size_t i = 0; i < header->eh_entries; i++){
-			uint64_t lbaOff = (uint64_t) (extents[i].ee_start_lo | ((uint64_t) extents[i].ee_start_hi << 32)) * blockSize / 512;
-			status = msio_read_drive(driveLabel, partStart + lbaOff, extents[i].ee_len * blockSize / 512, (size_t) destLocation + blockSize * extents[i].ee_block);
+	for(size_t i = 0; i < count; i++)
+		keys[i] = ((uint64_t) ((ext_dir_info*) list_array_get(list, i))->inode << 32) | i;
+	ext_sort_u64(keys, count);
+	for(size_t i = 0; i < count;){
+		// the inode table blocks of the next batch of entries are fetched first, sorted and merged
+		size_t batch = 0;
+		size_t end = i;
+		uint64_t lastBlock = 0;
+		for(; end < count; end++){
+			uint64_t block = 0;
+			size_t offset = 0;
+			status = ext_inode_location(mount, keys[end] >> 32, &block, &offset);
 			CERROR();
+			if(batch > 0 && block == lastBlock)
+				continue;
+			if(batch >= limit)
+				break;
+			blocks[batch++] = block;
+			lastBlock = block;
 		}
-	}else{
-		ext_extent_idx* extentNodes = (ext_extent_idx*) ((size_t) header + sizeof(ext_extent_header));
-		for(size_t i = 0; i < header->eh_entries; i++){
-			uint64_t lbaOff = (uint64_t) (extentNodes[i].ei_leaf_lo | ((uint64_t) extentNodes[i].ei_leaf_hi << 32)) * blockSize / 512;
-			status = msio_read_drive(driveLabel, partStart + lbaOff, blockSize / 512, (size_t) tempData);
-			CERROR();
-			status = ext_read_extent(driveLabel, partStart, tempData, blockSize, destLocation);
-			CERROR();
+		if(batch > 1)
+			ext_block_prefetch(mount, blocks, batch, EXT_IO_INODE); // only an optimization, the blocks are read again below if this fails
+		for(; i < end; i++){
+			ext_dir_info* info = list_array_get(list, keys[i] & 0xffffffff);
+			ext_inode inodeData;
+			// read through the block cache without filling the inode cache with every entry of the directory
+			void* raw = ext_inode_cache_find(mount, info->inode);
+			void* buf = NULL;
+			if(!raw){
+				uint64_t block = 0;
+				size_t offset = 0;
+				status = ext_inode_location(mount, info->inode, &block, &offset);
+				CERROR();
+				status = ext_block_get(mount, block, EXT_IO_INODE, &buf);
+				CERROR();
+				raw = buf + offset;
+				if((mount->flags & 2) && !ext_inode_csum_verify(mount, info->inode, raw)){
+					ext_block_put(mount, buf);
+					FERROR(TSX_INVALID_FORMAT);
+				}
+			}
+			ext_copy_inode(mount, &inodeData, raw);
+			info->size = ext_inode_size(mount, &inodeData);
+			if(buf)
+				ext_block_put(mount, buf);
 		}
 	}
 	_end:
-	if(tempData)
-		kfree_aligned(tempData, blockSize);
+	if(blocks)
+		ext_scratch_free(mount, blocks, limit * sizeof(uint64_t));
+	if(keys)
+		ext_scratch_free(mount, keys, count * sizeof(uint64_t));
 	return status;
 }
 
+void ext_sort_u64(uint64_t* values, size_t count){ // heap sort, ascending
+	for(size_t start = count / 2; start-- > 0;)
+		ext_sort_sift(values, start, count);
+	for(size_t end = count; end-- > 1;){
+		uint64_t tmp = values[0];
+		values[0] = values[end];
+		values[end] = tmp;
+		ext_sort_sift(values, 0, end);
+	}
+}
+
+void ext_sort_sift(uint64_t* values, size_t root, size_t count){
+	while(root * 2 + 1 < count){
+		size_t child = root * 2 + 1;
+		if(child + 1 < count && values[child + 1] > values[child])
+			child++;
+		if(values[root] >= values[child])
+			break;
+		uint64_t tmp = values[root];
+		values[root] = values[child];
+		values[child] = tmp;
+		root = child;
+	}
+}
+
 
 bool vfs_isFilesystem(char* driveLabel, uint64_t partStart){
-	ext_superblock* sb = kmalloc_aligned(4096);
+	ext_superblock* sb = ext_kmalloc_aligned(4096);
 	if(!sb)
 		return FALSE;
+	// always read from the device, the partition may have been replaced or reformatted since it was mounted
 	status_t status = msio_read_drive(driveLabel, partStart + 2, 1, (size_t) sb);
-	if(status == TSX_SUCCESS && sb->s_magic == EXT_MAGIC && (sb->s_feature_incompat & ~ext_incompat_support) == 0){
-		kfree_aligned(sb, 4096);
-		return TRUE;
-	}else{
-		kfree_aligned(sb, 4096);
-		return FALSE;
-	}
+	bool result = status == TSX_SUCCESS && sb->s_magic == EXT_MAGIC && (sb->s_feature_incompat & ~ext_incompat_support) == 0;
+	ext_mount* mount = ext_mount_find(driveLabel, partStart);
+	if(mount && (!result || memcmp(sb->s_uuid, mount->sb.s_uuid, sizeof(mount->sb.s_uuid)) != 0))
+		ext_mount_invalidate(mount);
+	ext_kfree_aligned(sb, 4096);
+	return result;
 }
 
 status_t vfs_readFile(char* driveLabel, uint64_t partStart, char* path, size_t dest){
 	uint32_t inode = 0;
-	void* destTemp = NULL;
-	status_t status = ext_get_file(driveLabel, partStart, path, &inode);
+	ext_mount* mount = NULL;
+	ext_file file;
+	status_t status = ext_mount_get(driveLabel, partStart, &mount);
+	CERROR();
+	ext_plan_entry* entry = ext_plan_find(mount, path);
+	if(entry){
+		status = ext_plan_read(mount, entry, (void*) dest);
+		goto _end;
+	}
+	status = ext_get_file(mount, path, &inode);
 	CERROR();
-	ext_inode inodeData;
-	status = ext_get_inode(driveLabel, partStart, inode, &inodeData);
+	status = ext_file_open(mount, inode, &file);
 	CERROR();
-	// the caller will probably only explicitly allocate a buffer of size fileSize, but data is read to a buffer of size fileSizeAbs (which is larger)
-	// use a temporary buffer to read to to only ever read to explicitly allocated memory
-	size_t fileSize = 0;
-	size_t fileSizeAbs = 0;
-	status = ext_read_inode(driveLabel, partStart, &inodeData, &destTemp, &fileSize, &fileSizeAbs);
+	// the caller will probably only explicitly allocate a buffer of size fileSize, only the last partial block is read through a bounce buffer
+	status = ext_read_inode_to(&file, (void*) dest);
+	if(status == TSX_SUCCESS)
+		ext_plan_record(mount, path, &file); // the plan is only an optimization, failing to update it is not an error
+	ext_file_close(&file);
 	CERROR();
-	memcpy((void*) dest, destTemp, fileSize);
 	_end:
-	if(destTemp)
-		kfree_aligned(destTemp, fileSizeAbs);
 	return status;
 }
 
 status_t vfs_getFileSize(char* driveLabel, uint64_t partStart, char* path, size_t* sizeWrite){
 	uint32_t inode = 0;
-	status_t status = ext_get_file(driveLabel, partStart, path, &inode);
+	ext_mount* mount = NULL;
+	status_t status = ext_mount_get(driveLabel, partStart, &mount);
 	CERROR();
-	ext_inode inodeData;
-	status = ext_get_inode(driveLabel, partStart, inode, &inodeData);
-	CERROR();
-	size_t size = inodeData.i_size_lo;
+	uint64_t size = 0;
+	ext_plan_entry* entry = ext_plan_find(mount, path);
+	if(entry){
+		size = entry->size;
+	}else{
+		status = ext_get_file(mount, path, &inode);
+		CERROR();
+		ext_inode inodeData;
+		status = ext_get_inode(mount, inode, &inodeData);
+		CERROR();
+		size = ext_inode_size(mount, &inodeData);
+	}
+	if(size > SIZE_MAX)
+		FERROR(TSX_TOO_LARGE);
 	if(sizeWrite)
 		*sizeWrite = size;
 	_end:
 	return status;
 }
 
-status_t vfs_listDir(char* driveLabel, uint64_t partStart, char* path, list_array** listWrite){
+status_t vfs_listDirIterate(char* driveLabel, uint64_t partStart, char* path, ext_dir_callback callback, void* arg){
 	uint32_t inode = 0;
-	status_t status = ext_get_dir(driveLabel, partStart, path, &inode);
+	ext_mount* mount = NULL;
+	status_t status = ext_mount_get(driveLabel, partStart, &mount);
+	CERROR();
+	status = ext_get_dir(mount, path, &inode);
 	CERROR();
-	ext_inode inodeData;
-	status = ext_get_inode(driveLabel, partStart, inode, &inodeData);
+	ext_file dir;
+	status = ext_file_open(mount, inode, &dir);
 	CERROR();
-	ext_dir_entry* dirEntry = NULL;
-	size_t dirTableSize = 0;
-	size_t dirTableSizeAbs = 0;
-	status = ext_read_inode(driveLabel, partStart, &inodeData, (void**) &dirEntry, &dirTableSize, &dirTableSizeAbs);
+	status = ext_dir_iterate(&dir, callback, arg);
+	ext_file_close(&dir);
 	CERROR();
-	ext_dir_entry* startEntry = dirEntry;
+	_end:
+	return status;
+}
+
+status_t vfs_listDir(char* driveLabel, uint64_t partStart, char* path, list_array** listWrite){
 	list_array* list = list_array_create(0);
-	while(1){
-		if(dirEntry->name_len > 0){
-			char* name = kmalloc(dirEntry->name_len + 1);
-			if(!name)
-				FERROR(TSX_OUT_OF_MEMORY);
-			memcpy(name, dirEntry->name, dirEntry->name_len);
-			name[dirEntry->name_len] = 0;
-			list_array_push(list, name);
+	if(!list)
+		return TSX_OUT_OF_MEMORY;
+	status_t status = vfs_listDirIterate(driveLabel, partStart, path, ext_dir_list_add, list);
+	if(status != TSX_SUCCESS){
+		for(size_t i = 0; i < list->length; i++){
+			char* name = list_array_get(list, i);
+			kfree(name, strlen(name) + 1);
 		}
-		dirEntry = (ext_dir_entry*) ((size_t) dirEntry + dirEntry->rec_len);
-		if((size_t) dirEntry >= (size_t) startEntry + dirTableSize || dirEntry->rec_len == 0){
+		list_array_delete(list);
+		return status;
+	}
+	*listWrite = list;
+	return status;
+}
+
+status_t vfs_listDirPooled(char* driveLabel, uint64_t partStart, char* path, ext_name_pool* pool){ // pool must be zeroed or hold earlier names, release with ext_name_pool_free
+	return vfs_listDirIterate(driveLabel, partStart, path, ext_name_pool_add, pool);
+}
+
+status_t vfs_listDirPlus(char* driveLabel, uint64_t partStart, char* path, list_array** listWrite){ // list of ext_dir_info*, free each with kfree(info, sizeof(ext_dir_info) + info->nameLen + 1)
+	uint32_t inode = 0;
+	ext_mount* mount = NULL;
+	ext_file dir;
+	memset(&dir, 0, sizeof(ext_file));
+	status_t status = ext_mount_get(driveLabel, partStart, &mount);
+	CERROR();
+	status = ext_get_dir(mount, path, &inode);
+	CERROR();
+	status = ext_file_open(mount, inode, &dir);
+	CERROR();
+	status = ext_read_dir_plus(&dir, listWrite);
+	CERROR();
+	_end:
+	if(dir.mount)
+		ext_file_close(&dir);
+	return status;
+}
+
+status_t vfs_readFiles(char* driveLabel, uint64_t partStart, size_t count, char** paths, size_t* dests, status_t* statuses){ // statuses receives the result of every file, the first failure is returned
+	status_t status = 0;
+	ext_mount* mount = NULL;
+	ext_batch batch;
+	memset(&batch, 0, sizeof(ext_batch));
+	status = ext_mount_get(driveLabel, partStart, &mount);
+	if(status != TSX_SUCCESS){
+		for(size_t i = 0; i < count; i++)
+			statuses[i] = status;
+		goto _end;
+	}
+	// resolve everything first, then read all files together in ascending LBA order
+	for(size_t i = 0; i < count; i++)
+		statuses[i] = ext_batch_add_file(mount, &batch, i, paths[i], (void*) dests[i]);
+	ext_batch_sort(batch.reads, batch.count);
+	ext_batch_run(mount, &batch, statuses);
+	for(size_t i = 0; i < count; i++){
+		if(statuses[i] != TSX_SUCCESS){
+			status = statuses[i];
 			break;
 		}
 	}
-	kfree_aligned(startEntry, dirTableSizeAbs);
-	*listWrite = list;
+	_end:
+	ext_batch_free(&batch);
+	return status;
+}
+
+status_t vfs_getFileMap(char* driveLabel, uint64_t partStart, char* path, ext_file_run** runsWrite, size_t* countWrite){ // free the runs with kfree(runs, count * sizeof(ext_file_run)) if count is not 0
+	uint32_t inode = 0;
+	ext_mount* mount = NULL;
+	status_t status = ext_mount_get(driveLabel, partStart, &mount);
+	CERROR();
+	status = ext_get_file(mount, path, &inode);
+	CERROR();
+	ext_file file;
+	status = ext_file_open(mount, inode, &file);
+	CERROR();
+	status = ext_file_map(&file, runsWrite, countWrite);
+	ext_file_close(&file);
+	CERROR();
+	_end:
+	return status;
+}
+
+status_t vfs_readFileRange(char* driveLabel, uint64_t partStart, char* path, uint64_t offset, size_t length, size_t dest, size_t* lengthWrite){
+	uint32_t inode = 0;
+	ext_mount* mount = NULL;
+	status_t status = ext_mount_get(driveLabel, partStart, &mount);
+	CERROR();
+	status = ext_get_file(mount, path, &inode);
+	CERROR();
+	ext_file file;
+	status = ext_file_open(mount, inode, &file);
+	CERROR();
+	status = ext_read_inode_range(&file, offset, length, (void*) dest, lengthWrite);
+	ext_file_close(&file);
+	CERROR();
 	_end:
 	return status;
 }
 
+status_t vfs_readFileChunked(char* driveLabel, uint64_t partStart, char* path, uint64_t offset, uint64_t length, size_t chunkSize, ext_read_callback callback, void* arg){
+	uint32_t inode = 0;
+	ext_mount* mount = NULL;
+	status_t status = ext_mount_get(driveLabel, partStart, &mount);
+	CERROR();
+	status = ext_get_file(mount, path, &inode);
+	CERROR();
+	ext_file file;
+	status = ext_file_open(mount, inode, &file);
+	CERROR();
+	status = ext_read_inode_chunked(&file, offset, length, chunkSize, callback, arg);
+	ext_file_close(&file);
+	CERROR();
+	_end:
+	return status;
+}
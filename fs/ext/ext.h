@@ -16,6 +16,102 @@
 
 #define EXT_MAGIC 0xEF53
 
+#define EXT_MAX_MOUNTS 8
+
+// number of device reads of each mount kept for ext_io_dump (0 to disable)
+#ifndef EXT_IO_TRACE_SIZE
+#define EXT_IO_TRACE_SIZE 0
+#endif
+
+// number of block groups whose inode table location is kept per mount (0 to disable)
+#ifndef EXT_GROUP_CACHE_SIZE
+#define EXT_GROUP_CACHE_SIZE 16
+#endif
+
+// number of decoded inodes kept per mount (0 to disable)
+#ifndef EXT_INODE_CACHE_SIZE
+#define EXT_INODE_CACHE_SIZE 64
+#endif
+
+// number of directory entries (including negative ones) kept per mount (0 to disable)
+#ifndef EXT_DENTRY_CACHE_SIZE
+#define EXT_DENTRY_CACHE_SIZE 128
+#endif
+
+// longer names are never cached
+#define EXT_DENTRY_NAME_MAX 52
+
+// bytes of metadata blocks kept per mount (0 to disable)
+#ifndef EXT_BLOCK_CACHE_SIZE
+#define EXT_BLOCK_CACHE_SIZE 0x40000
+#endif
+
+// unrequested blocks that may be read in between two prefetched blocks to save a device command
+#ifndef EXT_PREFETCH_MAX_GAP
+#define EXT_PREFETCH_MAX_GAP 8
+#endif
+
+// largest command of vfs_readFiles that combines pieces of different files or partial blocks (at least the block size)
+#ifndef EXT_BATCH_BOUNCE_SIZE
+#define EXT_BATCH_BOUNCE_SIZE 0x10000
+#endif
+
+// record the physical layout of the files read during boot in a plan file and read them from there on the next boot;
+// this writes to the filesystem (only ever to the plan file, and only if the filesystem was cleanly unmounted)
+#ifndef EXT_BOOT_PLAN
+#define EXT_BOOT_PLAN 0
+#endif
+
+// the plan is only used if one of these files exists, the second one is for a separate /boot partition; it must be
+// a regular file with written (not just allocated) blocks, for example created with "dd if=/dev/zero bs=4096 count=4"
+#ifndef EXT_BOOT_PLAN_PATH
+#define EXT_BOOT_PLAN_PATH "/boot/sxboot.plan"
+#endif
+#ifndef EXT_BOOT_PLAN_ROOT_PATH
+#define EXT_BOOT_PLAN_ROOT_PATH "/sxboot.plan"
+#endif
+#define EXT_BOOT_PLAN_MIN_SIZE 512
+#define EXT_BOOT_PLAN_MAX_SIZE 0x40000
+#define EXT_BOOT_PLAN_MAGIC 0x50427873
+#define EXT_BOOT_PLAN_VERSION 1
+#define EXT_BOOT_PLAN_PATH_SIZE(len) (((len) + 7) & ~7)
+
+// directory blocks fetched together while iterating over a directory
+#ifndef EXT_DIR_READAHEAD
+#define EXT_DIR_READAHEAD 32
+#endif
+
+// initial size of a directory name pool, doubled whenever it is full
+#ifndef EXT_NAME_POOL_MIN_SIZE
+#define EXT_NAME_POOL_MIN_SIZE 512
+#endif
+
+// scratch arena of each mount for temporary buffers: room for the nodes of a tree walk without a block cache, a bounce
+// block and a cursor leaf (or the bounce buffer of a batch read if that is larger) plus EXT_SCRATCH_EXTRA bytes for small
+// buffers, anything that does not fit comes from the heap
+#ifndef EXT_SCRATCH_EXTRA
+#define EXT_SCRATCH_EXTRA 0x1000
+#endif
+#define EXT_SCRATCH_BLOCKS (EXT_EXTENT_MAX_DEPTH + 2)
+#define EXT_SCRATCH_ALIGN 16
+
+// check metadata_csum checksums of metadata read from disk, each cached block is only checked once
+#ifndef EXT_VERIFY_CHECKSUMS
+#define EXT_VERIFY_CHECKSUMS 1
+#endif
+
+// largest single device read issued for file data (must fit the 16-bit sector count of msio)
+#ifndef EXT_MAX_TRANSFER_SECTORS
+#define EXT_MAX_TRANSFER_SECTORS 0x8000
+#endif
+
+#define EXT_COMPAT_DIR_INDEX 0x20
+#define EXT_COMPAT_SPARSE_SUPER2 0x200
+
+#define EXT_RO_COMPAT_SPARSE_SUPER 0x1
+
+#define EXT_RO_COMPAT_METADATA_CSUM 0x400
+
 #define EXT_INCOMPAT_COMPRESSION 0x1
 #define EXT_INCOMPAT_FILETYPE 0x2
 #define EXT_INCOMPAT_RECOVER 0x4
@@ -32,12 +128,66 @@
 #define EXT_INCOMPAT_INLINE_DATA 0x8000
 #define EXT_INCOMPAT_ENCRYPT 0x10000
 
+#define EXT_STATE_VALID 0x1
+#define EXT_STATE_ERROR 0x2
+
 #define EXT_INODE_TYPE_FILE 1
 #define EXT_INODE_TYPE_DIRECTORY 2
+#define EXT_INODE_TYPE_SYMLINK 7
+
+// symbolic links followed during a single path lookup
+#define EXT_MAX_SYMLINKS 8
 
 #define EXT_INODE_EXTENT_HEADER_MAGIC 0xF30A
+// bytes of i_block (i_blocks and i_block_i1 - i_block_i3), holding the extent tree root
+#define EXT_INODE_I_BLOCK_SIZE 60
+
+// ee_len above 32768 marks an unwritten (preallocated) extent of ee_len - 32768 blocks
+#define EXT_EXTENT_MAX_INIT_LEN 32768
+#define EXT_EXTENT_UNWRITTEN(extent) ((extent)->ee_len > EXT_EXTENT_MAX_INIT_LEN)
+#define EXT_EXTENT_LENGTH(extent) (EXT_EXTENT_UNWRITTEN(extent) ? (extent)->ee_len - EXT_EXTENT_MAX_INIT_LEN : (extent)->ee_len)
 
+#define EXT_S_IFMT 0xF000
+#define EXT_S_IFDIR 0x4000
+#define EXT_S_IFREG 0x8000
+#define EXT_S_IFLNK 0xA000
+
+#define EXT_INODE_INDEX_FL 0x1000
 #define EXT_INODE_EXTENTS_FL 0x80000
+#define EXT_INODE_INLINE_DATA_FL 0x10000000
+
+#define EXT_XATTR_MAGIC 0xEA020000
+#define EXT_XATTR_INDEX_SYSTEM 7
+
+#define EXT_FLAGS_SIGNED_HASH 0x1
+#define EXT_FLAGS_UNSIGNED_HASH 0x2
+
+#define EXT_DX_HASH_LEGACY 0
+#define EXT_DX_HASH_HALF_MD4 1
+#define EXT_DX_HASH_TEA 2
+#define EXT_DX_HASH_LEGACY_UNSIGNED 3
+#define EXT_DX_HASH_HALF_MD4_UNSIGNED 4
+#define EXT_DX_HASH_TEA_UNSIGNED 5
+
+// root plus up to two index levels with LARGEDIR
+#define EXT_DX_MAX_LEVELS 3
+
+// deepest extent tree created by the kernel
+#define EXT_EXTENT_MAX_DEPTH 5
+
+#define EXT_LRU_NONE 0xffffffff
+
+// block cache entry flag: the checksum of the block has been verified
+#define EXT_BLOCK_VERIFIED 0x2
+
+#define EXT_CRC32C_POLY 0x82F63B78
+
+#ifndef offsetof
+#define offsetof(type, member) __builtin_offsetof(type, member)
+#endif
+#define EXT_DIR_TAIL_FT 0xDE
+
+#define EXT_BLOCK_END UINT64_MAX
 
 
 #pragma pack(push,1)
@@ -102,7 +252,42 @@ typedef struct ext_superblock{
 	uint16_t s_min_extra_isize;
 	uint16_t s_want_extra_isize;
 	uint32_t s_flags;
-	// ....
+	uint16_t s_raid_stride;
+	uint16_t s_mmp_update_interval;
+	uint64_t s_mmp_block;
+	uint32_t s_raid_stripe_width;
+	uint8_t s_log_groups_per_flex;
+	uint8_t s_checksum_type;
+	uint8_t s_encryption_level;
+	uint8_t s_reserved_pad;
+	uint64_t s_kbytes_written;
+	uint32_t s_snapshot_inum;
+	uint32_t s_snapshot_id;
+	uint64_t s_snapshot_r_blocks_count;
+	uint32_t s_snapshot_list;
+	uint32_t s_error_count;
+	uint32_t s_first_error_time;
+	uint32_t s_first_error_ino;
+	uint64_t s_first_error_block;
+	uint8_t s_first_error_func[32];
+	uint32_t s_first_error_line;
+	uint32_t s_last_error_time;
+	uint32_t s_last_error_ino;
+	uint32_t s_last_error_line;
+	uint64_t s_last_error_block;
+	uint8_t s_last_error_func[32];
+	uint8_t s_mount_opts[64];
+	uint32_t s_usr_quota_inum;
+	uint32_t s_grp_quota_inum;
+	uint32_t s_overhead_clusters;
+	uint32_t s_backup_bgs[2];
+	uint8_t s_encrypt_algos[4];
+	uint8_t s_encrypt_pw_salt[16];
+	uint32_t s_lpf_ino;
+	uint32_t s_prj_quota_inum;
+	uint32_t s_checksum_seed;
+	uint8_t s_reserved[0x188];
+	uint32_t s_checksum;
 } ext_superblock;
 
 typedef struct ext_group_desc{
@@ -153,7 +338,7 @@ typedef struct ext_inode{
 	uint32_t i_file_acl_lo;
 	uint32_t i_size_high;
 	uint32_t i_obso_faddr;
-	uint32_t i_osd2;
+	uint8_t i_osd2[12];
 	uint16_t i_extra_isize;
 	uint16_t i_checksum_hi;
 	uint32_t i_ctime_extra;
@@ -194,16 +379,419 @@ typedef struct ext_dir_entry{
 	uint8_t file_type;
 	char name[0];
 } ext_dir_entry;
+
+typedef struct ext_dir_entry_tail{
+	uint32_t det_reserved_zero1;
+	uint16_t det_rec_len;
+	uint8_t det_reserved_zero2;
+	uint8_t det_reserved_ft;
+	uint32_t det_checksum;
+} ext_dir_entry_tail;
+
+typedef struct ext_xattr_entry{
+	uint8_t e_name_len;
+	uint8_t e_name_index;
+	uint16_t e_value_offs;
+	uint32_t e_value_inum;
+	uint32_t e_value_size;
+	uint32_t e_hash;
+	char e_name[0];
+} ext_xattr_entry;
+
+typedef struct ext_dx_root_info{
+	uint32_t reserved_zero;
+	uint8_t hash_version;
+	uint8_t info_length;
+	uint8_t indirect_levels;
+	uint8_t unused_flags;
+} ext_dx_root_info;
+
+typedef struct ext_dx_countlimit{
+	uint16_t limit;
+	uint16_t count;
+} ext_dx_countlimit;
+
+typedef struct ext_dx_entry{
+	uint32_t hash; // ext_dx_countlimit in the first entry of a node
+	uint32_t block;
+} ext_dx_entry;
 #pragma pack(pop)
 
 
-status_t ext_get_file(char* driveLabel, uint64_t partStart, char* path, uint32_t* inode);
-status_t ext_get_dir(char* driveLabel, uint64_t partStart, char* path, uint32_t* inode);
-status_t ext_get_path_inode(char* driveLabel, uint64_t partStart, char* path, uint32_t* inode, uint8_t* type);
-status_t ext_get_inode(char* driveLabel, uint64_t partStart, uint32_t inode, ext_inode* inodeData);
-status_t ext_read_inode(char* driveLabel, uint64_t partStart, ext_inode* inode, void** location, size_t* size, size_t* absSizeWrite);
-status_t ext_read_inode_to(char* driveLabel, uint64_t partStart, ext_inode* inode, void* location);
-status_t ext_read_indirect_blocks(char* driveLabel, uint64_t partStart, uint32_t blockSize, uint32_t blockTable, uint32_t depth, void** writeLoc);
-status_t ext_read_extent(char* driveLabel, uint64_t partStart, ext_extent_header* header, size_t blockSize, void* destLocation);
+typedef struct ext_lru_link{
+	uint32_t prev;
+	uint32_t next;
+	uint32_t hashNext;
+	uint32_t hash;
+	uint16_t refs;
+	uint16_t flags; // 0 valid, 15:1 owner-defined
+} ext_lru_link;
+
+// fixed-size LRU table; entries are linked by index so that only the array pointers need relocation
+typedef struct ext_lru{
+	void* entries;
+	size_t entrySize;
+	uint32_t capacity;
+	uint32_t used;
+	uint32_t head; // most recently used
+	uint32_t tail; // least recently used
+	uint32_t* buckets;
+	uint32_t bucketCount;
+} ext_lru;
+
+typedef struct ext_group_cache_entry{
+	ext_lru_link link;
+	uint32_t group;
+	uint32_t reserved;
+	uint64_t inodeTable;
+} ext_group_cache_entry;
+
+typedef struct ext_inode_cache_entry{
+	ext_lru_link link;
+	uint32_t inode;
+	uint32_t reserved;
+	uint8_t data[0]; // on-disk inode (inodeSize bytes)
+} ext_inode_cache_entry;
+
+typedef struct ext_dentry_cache_entry{
+	ext_lru_link link;
+	uint32_t parent;
+	uint32_t inode; // 0 if the name does not exist in parent
+	uint8_t type;
+	uint8_t nameLen;
+	char name[EXT_DENTRY_NAME_MAX];
+} ext_dentry_cache_entry;
+
+typedef struct ext_block_cache_entry{
+	ext_lru_link link;
+	uint64_t lba;
+} ext_block_cache_entry;
+
+// contiguous range of file blocks stored in contiguous device blocks
+typedef struct ext_run{
+	uint64_t fileBlock;
+	uint64_t devBlock;
+	uint64_t length;
+} ext_run;
+
+typedef struct ext_run_list{
+	ext_run* runs;
+	size_t count;
+	size_t capacity;
+	struct ext_mount* mount; // runs are temporary and taken from the scratch arena of this mount, NULL for the heap
+} ext_run_list;
+
+// part of the physical layout of a file returned by vfs_getFileMap, file bytes [offset, offset + sectors * 512) are
+// stored at lba (the last run of a file may end in the middle of its last sector)
+typedef struct ext_file_run{
+	uint64_t lba;
+	uint64_t sectors;
+	uint64_t offset;
+} ext_file_run;
+
+typedef struct ext_plan_header{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t checksum; // crc32c of the rest of the used part of the plan
+	uint32_t length; // used bytes including this header
+	uint32_t reserved;
+	uint32_t entries;
+} ext_plan_header;
+
+// followed by the path (padded to 8 bytes) and runCount ext_run; an entry is only used while the inode still has the
+// recorded generation, mtime and size
+typedef struct ext_plan_entry{
+	uint32_t length;
+	uint32_t inode;
+	uint32_t generation;
+	uint32_t mtime;
+	uint64_t size;
+	uint16_t pathLen;
+	uint16_t reserved;
+	uint32_t runCount;
+	char path[0];
+} ext_plan_entry;
+
+// one queued device read of vfs_readFiles
+typedef struct ext_batch_read{
+	uint64_t lba;
+	size_t sectors;
+	void* dest;
+	size_t length; // bytes copied to dest, less than sectors * 512 only for the last block of a file
+	size_t file; // index of the file in the request
+} ext_batch_read;
+
+typedef struct ext_batch{
+	ext_batch_read* reads;
+	size_t count;
+	size_t capacity;
+} ext_batch;
+
+// receives consecutive chunks of a file; offset is the file offset of data
+typedef status_t (*ext_read_callback)(void* arg, uint64_t offset, void* data, size_t length);
+// name is not null-terminated and only valid during the call
+typedef status_t (*ext_dir_callback)(void* arg, uint32_t inode, uint8_t type, char* name, size_t nameLen);
+
+// names stored back to back in one allocation, each followed by a null byte
+typedef struct ext_name_pool{
+	char* data;
+	size_t size;
+	size_t length;
+	size_t count;
+} ext_name_pool;
+
+// reason for a device read, index into ext_stats.io
+#define EXT_IO_SUPERBLOCK 0
+#define EXT_IO_GDT 1
+#define EXT_IO_INODE 2
+#define EXT_IO_DIRECTORY 3
+#define EXT_IO_INDIRECT 4
+#define EXT_IO_EXTENT 5
+#define EXT_IO_DATA 6
+#define EXT_IO_PLAN 7
+#define EXT_IO_CAUSES 8
+
+typedef struct ext_io_counter{
+	uint64_t commands;
+	uint64_t sectors;
+	uint64_t timeMs;
+} ext_io_counter;
+
+typedef struct ext_io_trace_entry{
+	uint64_t lba;
+	uint16_t sectors;
+	uint8_t cause;
+	uint8_t reserved;
+	uint32_t timeMs;
+} ext_io_trace_entry;
+
+typedef struct ext_stats{
+	uint64_t mountHits; // lookups served by an existing mount
+	uint64_t mountMisses; // mounts created (superblock and descriptors read from disk)
+	uint64_t sbReadsSaved; // superblock reads avoided by reusing the mount
+	uint64_t descReadsSaved; // group descriptor sector reads avoided by the group cache
+	uint64_t groupCacheHits;
+	uint64_t groupCacheMisses; // group descriptor sectors read
+	uint64_t inodeCacheHits;
+	uint64_t inodeCacheMisses;
+	uint64_t dentryCacheHits;
+	uint64_t dentryCacheNegativeHits;
+	uint64_t dentryCacheMisses;
+	uint64_t blockCacheHits;
+	uint64_t blockCacheMisses;
+	uint64_t blockCacheBytesSaved;
+	uint64_t extentCursorHits;
+	uint64_t extentTreeWalks;
+	uint64_t zeroFilledBytes;
+	uint64_t checksumsVerified;
+	uint64_t checksumFailures;
+	uint64_t prefetchReads;
+	uint64_t prefetchBlocks;
+	uint64_t batchReads; // device commands issued by vfs_readFiles
+	uint64_t planHits; // files served from the boot plan without a path walk
+	uint64_t planMisses;
+	uint64_t planWrites;
+	uint64_t deviceReads; // read commands issued to the drive
+	uint64_t deviceSectors;
+	uint64_t deviceWrites;
+	uint64_t allocBytes; // heap memory currently held by the module (all mounts)
+	uint64_t allocPeakBytes; // since the first allocation or the last ext_alloc_reset_peak
+	uint64_t allocCalls;
+	uint64_t scratchAllocs; // temporary buffers taken from the scratch arena
+	uint64_t scratchFallbacks; // temporary buffers that did not fit and came from the heap
+	ext_io_counter io[EXT_IO_CAUSES];
+} ext_stats;
+
+// remembers the extent leaf used last so that sequential lookups do not walk the tree again
+typedef struct ext_extent_cursor{
+	bool valid;
+	void* leaf; // copy of the leaf node, unused if the root in the inode is the leaf
+	uint64_t leafBlock;
+	uint64_t start; // first file block covered by the leaf
+	uint64_t end; // first file block not covered by the leaf (EXT_BLOCK_END if there is none)
+} ext_extent_cursor;
+
+typedef struct ext_mount{
+	uint8_t flags; // 0 present, 1 verify checksums, 2 boot plan looked up, 3 boot plan enabled, 7:4 reserved
+	char* driveLabel;
+	size_t driveLabelSize;
+	uint64_t partStart;
+	ext_superblock sb;
+	size_t blockSize;
+	uint32_t descSize;
+	uint32_t inodeSize;
+	uint32_t groupCount;
+	ext_lru groupCache;
+	ext_lru inodeCache;
+	ext_lru dentryCache;
+	ext_lru blockCache;
+	void* blockCacheData;
+	uint32_t csumSeed;
+	void* plan; // contents of the boot plan file
+	size_t planSize;
+	ext_run_list planRuns; // where the plan file itself is stored
+	void* scratch; // see ext_scratch_alloc
+	size_t scratchSize;
+	size_t scratchUsed;
+	size_t scratchLive; // buffers not released yet, the whole arena is free again once this drops to 0
+	ext_stats stats;
+#if EXT_IO_TRACE_SIZE > 0
+	ext_io_trace_entry trace[EXT_IO_TRACE_SIZE]; // ring of the last reads, traceNext counts every read
+	size_t traceNext;
+#endif
+} ext_mount;
+
+// entry returned by vfs_listDirPlus
+typedef struct ext_dir_info{
+	uint32_t inode;
+	uint8_t type;
+	uint8_t nameLen;
+	uint64_t size;
+	char name[0];
+} ext_dir_info;
+
+typedef struct ext_dx_frame{
+	void* block;
+	ext_dx_entry* entries;
+	ext_dx_entry* at;
+} ext_dx_frame;
+
+typedef struct ext_file{
+	ext_mount* mount;
+	uint32_t inode;
+	ext_inode inodeData;
+	uint32_t csumSeed; // checksum seed of this inode for its extent and directory blocks
+	ext_extent_cursor cursor;
+	void* inlineData; // contents of inline data inodes (i_block followed by the system.data attribute)
+	size_t inlineSize;
+} ext_file;
+
+
+// entry points added to the vfs interface by this module
+status_t vfs_readFileRange(char* driveLabel, uint64_t partStart, char* path, uint64_t offset, size_t length, size_t dest, size_t* lengthWrite);
+status_t vfs_readFileChunked(char* driveLabel, uint64_t partStart, char* path, uint64_t offset, uint64_t length, size_t chunkSize, ext_read_callback callback, void* arg);
+status_t vfs_readFiles(char* driveLabel, uint64_t partStart, size_t count, char** paths, size_t* dests, status_t* statuses);
+status_t vfs_getFileMap(char* driveLabel, uint64_t partStart, char* path, ext_file_run** runsWrite, size_t* countWrite);
+status_t vfs_listDirPlus(char* driveLabel, uint64_t partStart, char* path, list_array** listWrite);
+status_t vfs_listDirIterate(char* driveLabel, uint64_t partStart, char* path, ext_dir_callback callback, void* arg);
+status_t vfs_listDirPooled(char* driveLabel, uint64_t partStart, char* path, ext_name_pool* pool);
+status_t ext_mount_get(char* driveLabel, uint64_t partStart, ext_mount** mountWrite);
+ext_mount* ext_mount_find(char* driveLabel, uint64_t partStart);
+void ext_mount_invalidate(ext_mount* mount);
+void ext_invalidate(char* driveLabel, uint64_t partStart);
+status_t ext_get_stats(char* driveLabel, uint64_t partStart, ext_stats* statsWrite);
+void ext_io_dump(char* driveLabel, uint64_t partStart);
+void ext_alloc_reset_peak();
+status_t ext_dev_read(ext_mount* mount, uint8_t cause, uint64_t lba, uint64_t count, size_t dest);
+status_t ext_dev_write(ext_mount* mount, uint64_t lba, uint64_t count, size_t source);
+void* ext_kmalloc(size_t size);
+void ext_kfree(void* ptr, size_t size);
+void* ext_kmalloc_aligned(size_t size);
+void ext_kfree_aligned(void* ptr, size_t size);
+void ext_alloc_add(size_t size);
+void* ext_scratch_alloc(ext_mount* mount, size_t size);
+void ext_scratch_free(ext_mount* mount, void* ptr, size_t size);
+bool ext_scratch_grow(ext_mount* mount, void* ptr, size_t size, size_t newSize);
+status_t ext_group_inode_table(ext_mount* mount, uint32_t group, uint64_t* inodeTableWrite);
+uint64_t ext_group_desc_block(ext_mount* mount, uint32_t descBlock);
+bool ext_group_has_super(ext_mount* mount, uint32_t group);
+bool ext_is_power(uint32_t value, uint32_t base);
+
+ext_block_cache_entry* ext_block_entry(ext_mount* mount, void* data);
+bool ext_block_verified(ext_mount* mount, void* data);
+void ext_block_set_verified(ext_mount* mount, void* data);
+uint32_t ext_block_find(ext_mount* mount, uint64_t lba);
+status_t ext_block_prefetch(ext_mount* mount, uint64_t* blocks, size_t count, uint8_t cause);
+status_t ext_block_get(ext_mount* mount, uint64_t block, uint8_t cause, void** dataWrite);
+void ext_block_put(ext_mount* mount, void* data);
+
+status_t ext_lru_init(ext_lru* lru, uint32_t capacity, size_t entrySize);
+void ext_lru_free(ext_lru* lru);
+void* ext_lru_entry(ext_lru* lru, uint32_t index);
+uint32_t ext_lru_first(ext_lru* lru, uint32_t hash);
+uint32_t ext_lru_next(ext_lru* lru, uint32_t index);
+void ext_lru_touch(ext_lru* lru, uint32_t index);
+uint32_t ext_lru_insert(ext_lru* lru, uint32_t hash);
+void ext_lru_remove(ext_lru* lru, uint32_t index);
+
+status_t ext_get_file(ext_mount* mount, char* path, uint32_t* inode);
+status_t ext_get_dir(ext_mount* mount, char* path, uint32_t* inode);
+status_t ext_get_path_inode(ext_mount* mount, char* path, uint32_t* inode, uint8_t* type);
+status_t ext_symlink_resolve(ext_mount* mount, uint32_t inode, char* rest, char** pathWrite, size_t* pathSizeWrite);
+status_t ext_dir_find(ext_file* dir, char* name, size_t nameLen, uint32_t* inodeWrite, uint8_t* typeWrite);
+bool ext_dir_block_find(void* block, size_t size, char* name, size_t nameLen, uint32_t* inodeWrite, uint8_t* typeWrite);
+status_t ext_dir_iterate(ext_file* dir, ext_dir_callback callback, void* arg);
+status_t ext_dir_block_iterate(void* block, size_t size, ext_dir_callback callback, void* arg);
+status_t ext_name_pool_add(void* arg, uint32_t inode, uint8_t type, char* name, size_t nameLen);
+void ext_name_pool_free(ext_name_pool* pool);
+status_t ext_dir_list_add(void* arg, uint32_t inode, uint8_t type, char* name, size_t nameLen);
+status_t ext_dx_lookup(ext_file* dir, char* name, size_t nameLen, uint32_t* inodeWrite, uint8_t* typeWrite);
+status_t ext_dx_read_node(ext_file* dir, uint32_t fileBlock, size_t entriesOffset, ext_dx_frame* frame);
+ext_dx_entry* ext_dx_search(ext_dx_entry* entries, uint32_t hash);
+status_t ext_dx_next_leaf(ext_file* dir, ext_dx_frame* frames, size_t levels, uint32_t hash, bool* moreWrite);
+uint32_t ext_dx_hash(ext_mount* mount, uint8_t version, char* name, size_t nameLen);
+uint32_t ext_dx_hash_legacy(char* name, size_t nameLen, bool sign);
+void ext_dx_str2hashbuf(char* msg, size_t len, uint32_t* buf, size_t num, bool sign);
+void ext_dx_half_md4_transform(uint32_t* buf, uint32_t* in);
+void ext_dx_tea_transform(uint32_t* buf, uint32_t* in);
+status_t ext_dir_block_verify(ext_file* dir, void* block);
+uint32_t ext_dentry_hash(uint32_t parent, char* name, size_t nameLen);
+bool ext_dentry_lookup(ext_mount* mount, uint32_t parent, char* name, size_t nameLen, uint32_t* inode, uint8_t* type);
+void ext_dentry_insert(ext_mount* mount, uint32_t parent, char* name, size_t nameLen, uint32_t inode, uint8_t type);
+status_t ext_get_inode(ext_mount* mount, uint32_t inode, ext_inode* inodeData);
+status_t ext_get_inode_raw(ext_mount* mount, uint32_t inode, ext_inode* inodeData, void* raw);
+void* ext_inode_cache_find(ext_mount* mount, uint32_t inode);
+status_t ext_inode_location(ext_mount* mount, uint32_t inode, uint64_t* blockWrite, size_t* offsetWrite);
+void ext_copy_inode(ext_mount* mount, ext_inode* dest, void* raw);
+status_t ext_file_open(ext_mount* mount, uint32_t inode, ext_file* file);
+void ext_file_seed(ext_file* file);
+void ext_file_close(ext_file* file);
+status_t ext_inline_get(ext_mount* mount, void* raw, ext_file* file);
+status_t ext_read_inode_to(ext_file* file, void* location);
+status_t ext_read_inode_range(ext_file* file, uint64_t offset, size_t length, void* dest, size_t* lengthWrite);
+status_t ext_read_inode_chunked(ext_file* file, uint64_t offset, uint64_t length, size_t chunkSize, ext_read_callback callback, void* arg);
+void ext_read_inline(ext_file* file, uint64_t offset, size_t length, void* dest);
+uint64_t ext_inode_size(ext_mount* mount, ext_inode* inode);
+status_t ext_bmap(ext_file* file, uint64_t block, uint64_t* devBlockWrite);
+status_t ext_map_inode(ext_file* file, uint64_t startBlock, uint64_t endBlock, ext_run_list* list);
+status_t ext_map_indirect_blocks(ext_mount* mount, uint32_t blockTable, uint32_t depth, uint64_t* fileBlock, uint64_t startBlock, uint64_t endBlock, ext_run_list* list);
+status_t ext_map_extent(ext_file* file, uint64_t startBlock, uint64_t endBlock, ext_run_list* list);
+status_t ext_extent_block_verify(ext_file* file, void* block);
+status_t ext_extent_prefetch(ext_file* file, uint64_t startBlock, uint64_t endBlock);
+size_t ext_extent_collect(ext_extent_header* header, uint64_t startBlock, uint64_t endBlock, uint64_t* blocks, size_t count, size_t limit);
+status_t ext_extent_find_leaf(ext_file* file, uint64_t block, ext_extent_header** leafWrite);
+bool ext_extent_node_check(ext_extent_header* header, size_t size, uint16_t depth);
+size_t ext_extent_search(ext_extent_header* header, uint64_t block);
+status_t ext_file_map(ext_file* file, ext_file_run** runsWrite, size_t* countWrite);
+status_t ext_batch_add_file(ext_mount* mount, ext_batch* batch, size_t index, char* path, void* dest);
+status_t ext_batch_add(ext_batch* batch, uint64_t lba, size_t sectors, void* dest, size_t length, size_t file);
+void ext_batch_sort(ext_batch_read* reads, size_t count);
+void ext_batch_run(ext_mount* mount, ext_batch* batch, status_t* statuses);
+void ext_batch_free(ext_batch* batch);
+void ext_plan_load(ext_mount* mount);
+void ext_plan_free(ext_mount* mount);
+bool ext_plan_writable(ext_mount* mount);
+bool ext_plan_check(ext_plan_header* header, size_t size);
+ext_plan_entry* ext_plan_find(ext_mount* mount, char* path);
+status_t ext_plan_read(ext_mount* mount, ext_plan_entry* entry, void* dest);
+status_t ext_plan_record(ext_mount* mount, char* path, ext_file* file);
+status_t ext_plan_write(ext_mount* mount, size_t changed);
+status_t ext_read_dir_plus(ext_file* dir, list_array** listWrite);
+status_t ext_dir_plus_add(void* arg, uint32_t inode, uint8_t type, char* name, size_t nameLen);
+status_t ext_dir_info_fill(ext_mount* mount, list_array* list);
+void ext_sort_u64(uint64_t* values, size_t count);
+void ext_sort_sift(uint64_t* values, size_t root, size_t count);
+
+void ext_crc32c_init();
+uint32_t ext_crc32c(uint32_t crc, void* data, size_t length);
+bool ext_sb_csum_verify(ext_superblock* sb);
+bool ext_group_desc_csum_verify(ext_mount* mount, uint32_t group, ext_group_desc* desc);
+bool ext_inode_csum_verify(ext_mount* mount, uint32_t inode, void* raw);
+
+status_t ext_read_runs(ext_mount* mount, ext_run_list* list, void* dest, uint64_t offset, uint64_t length, uint8_t cause);
+
+status_t ext_run_list_add(ext_run_list* list, uint64_t fileBlock, uint64_t devBlock, uint64_t length);
+void ext_run_list_free(ext_run_list* list);
+void ext_run_list_release(ext_run_list* list);
 
 #endif /* __EXT_H__ */
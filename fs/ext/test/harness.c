@@ -0,0 +1,464 @@
+/*
+ * harness.c - runs fs/ext against a disk image and reports the device commands, sectors, peak heap use and wall time
+ * of each scenario. Every file read is compared with the tree the image was generated from.
+ *
+ * usage: exthost <image> <source tree> [-v] [-corrupt]
+ *   -v         print the read trace of the mount after the scenarios
+ *   -corrupt   the image has the metadata of /csum damaged, reading those files must fail
+ */
+
+#include <time.h>
+#include <stddef.h>
+#include "host.h"
+#include "ext.h"
+
+// the vfs interface every filesystem module implements, declared by the kernel
+bool vfs_isFilesystem(char* driveLabel, uint64_t partStart);
+status_t vfs_readFile(char* driveLabel, uint64_t partStart, char* path, size_t dest);
+status_t vfs_getFileSize(char* driveLabel, uint64_t partStart, char* path, size_t* sizeWrite);
+status_t vfs_listDir(char* driveLabel, uint64_t partStart, char* path, list_array** listWrite);
+
+#define HOST_DRIVE "hd0"
+#define HOST_MANY_FILES 3000
+
+typedef int (*host_scenario)(char* src);
+
+static bool host_corrupt = FALSE;
+
+static char* host_files[] = {"boot/kernel", "boot/initrd", "boot/tiny", "boot/empty", "boot/sparse", "boot/frag", "etc/conf", NULL};
+
+
+void* host_load(char* src, char* path, size_t* sizeWrite){ // contents of a file of the source tree
+	char hostPath[1024];
+	snprintf(hostPath, sizeof(hostPath), "%s/%s", src, path);
+	FILE* f = fopen(hostPath, "rb");
+	if(!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	size_t size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char* data = malloc(size + 1);
+	if(data && fread(data, 1, size, f) != size){
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	*sizeWrite = size;
+	return data;
+}
+
+void* host_load_range(char* src, char* path, uint64_t offset, size_t length){ // length bytes at offset of a file of the source tree
+	char hostPath[1024];
+	snprintf(hostPath, sizeof(hostPath), "%s/%s", src, path);
+	FILE* f = fopen(hostPath, "rb");
+	if(!f)
+		return NULL;
+	char* data = malloc(length + 1);
+	if(data && (fseeko(f, offset, SEEK_SET) != 0 || fread(data, 1, length, f) != length)){
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	return data;
+}
+
+int host_read_compare(char* src, char* path, char* hostPath){ // reads path with vfs_getFileSize and vfs_readFile, 0 if it matches hostPath
+	char fsPath[1024];
+	snprintf(fsPath, sizeof(fsPath), "/%s", path);
+	size_t refSize = 0;
+	char* ref = host_load(src, hostPath, &refSize);
+	size_t size = 0;
+	int fail = 1;
+	if(!ref || vfs_getFileSize(HOST_DRIVE, 0, fsPath, &size) != TSX_SUCCESS || size != refSize)
+		goto _end;
+	char* data = malloc(size + 1);
+	data[size] = 0x5a;
+	if(vfs_readFile(HOST_DRIVE, 0, fsPath, (size_t) data) == TSX_SUCCESS && memcmp(data, ref, size) == 0 && data[size] == 0x5a)
+		fail = 0;
+	free(data);
+	_end:
+	if(fail)
+		printf("  %s differs\n", fsPath);
+	free(ref);
+	return fail;
+}
+
+int host_read_all(char* src){
+	int fails = 0;
+	char path[256];
+	for(size_t i = 0; host_files[i]; i++)
+		fails += host_read_compare(src, host_files[i], host_files[i]);
+	for(int i = 1; i <= 40; i++){
+		snprintf(path, sizeof(path), "boot/modules/mod%d.ko", i);
+		fails += host_read_compare(src, path, path);
+	}
+	return fails;
+}
+
+
+int host_scenario_probe(char* src){
+	return vfs_isFilesystem(HOST_DRIVE, 0) ? 0 : 1;
+}
+
+int host_scenario_read_cold(char* src){
+	ext_invalidate(NULL, 0);
+	return host_read_all(src);
+}
+
+int host_scenario_read_warm(char* src){
+	return host_read_all(src);
+}
+
+int host_scenario_symlink(char* src){
+	return host_read_compare(src, "modlink/mod7.ko", "boot/modules/mod7.ko") + host_read_compare(src, "boot/conflink", "etc/conf");
+}
+
+int host_scenario_lookup(char* src){
+	int fails = 0;
+	char path[256];
+	for(int i = 1; i <= HOST_MANY_FILES; i += 10){
+		size_t size = 0;
+		snprintf(path, sizeof(path), "/boot/many/file_with_long_name_%d.txt", i);
+		if(vfs_getFileSize(HOST_DRIVE, 0, path, &size) != TSX_SUCCESS)
+			fails++;
+		snprintf(path, sizeof(path), "/boot/many/file_with_long_name_%dx.txt", i);
+		if(vfs_getFileSize(HOST_DRIVE, 0, path, &size) != TSX_NO_SUCH_FILE)
+			fails++;
+	}
+	return fails;
+}
+
+int host_scenario_list(char* src){
+	list_array* list = NULL;
+	if(vfs_listDir(HOST_DRIVE, 0, "/boot/many/", &list) != TSX_SUCCESS)
+		return 1;
+	int fail = list->length != HOST_MANY_FILES + 2;
+	for(size_t i = 0; i < list->length; i++){
+		char* name = list_array_get(list, i);
+		kfree(name, strlen(name) + 1);
+	}
+	list_array_delete(list);
+	return fail;
+}
+
+int host_scenario_list_plus(char* src){
+	list_array* list = NULL;
+	if(vfs_listDirPlus(HOST_DRIVE, 0, "/boot/many/", &list) != TSX_SUCCESS)
+		return 1;
+	int fails = list->length != HOST_MANY_FILES + 2;
+	char path[256];
+	for(size_t i = 0; i < list->length; i++){
+		ext_dir_info* info = list_array_get(list, i);
+		if(info->type == EXT_INODE_TYPE_FILE){
+			size_t refSize = 0;
+			snprintf(path, sizeof(path), "boot/many/%s", info->name);
+			char* ref = host_load(src, path, &refSize);
+			if(!ref || refSize != info->size)
+				fails++;
+			free(ref);
+		}
+		kfree(info, sizeof(ext_dir_info) + info->nameLen + 1);
+	}
+	list_array_delete(list);
+	return fails;
+}
+
+int host_scenario_batch(char* src){
+	char* paths[41];
+	size_t dests[41];
+	status_t statuses[41];
+	char* refs[41];
+	size_t sizes[41];
+	char path[256];
+	int fails = 0;
+	for(int i = 0; i < 41; i++){
+		snprintf(path, sizeof(path), i == 0 ? "boot/initrd" : "boot/modules/mod%d.ko", i);
+		refs[i] = host_load(src, path, &sizes[i]);
+		paths[i] = malloc(strlen(path) + 2);
+		sprintf(paths[i], "/%s", path);
+		dests[i] = (size_t) malloc(sizes[i] + 1);
+	}
+	if(vfs_readFiles(HOST_DRIVE, 0, 41, paths, dests, statuses) != TSX_SUCCESS)
+		fails++;
+	for(int i = 0; i < 41; i++){
+		if(statuses[i] != TSX_SUCCESS || !refs[i] || memcmp((void*) dests[i], refs[i], sizes[i]) != 0)
+			fails++;
+		free(paths[i]);
+		free((void*) dests[i]);
+		free(refs[i]);
+	}
+	return fails;
+}
+
+int host_scenario_range(char* src){
+	size_t size = 0;
+	char* ref = host_load(src, "boot/initrd", &size);
+	if(!ref)
+		return 1;
+	int fails = 0;
+	srand(1);
+	for(int i = 0; i < 200; i++){
+		uint64_t offset = rand() % (size + 100);
+		size_t length = (i % 4 == 0) ? rand() % 200000 : rand() % 5000;
+		size_t expected = offset >= size ? 0 : MIN(length, size - offset);
+		char* data = malloc(length + 1);
+		size_t got = 0;
+		if(vfs_readFileRange(HOST_DRIVE, 0, "/boot/initrd", offset, length, (size_t) data, &got) != TSX_SUCCESS || got != expected ||
+			memcmp(data, ref + offset, expected) != 0)
+			fails++;
+		free(data);
+	}
+	free(ref);
+	return fails;
+}
+
+static char* host_chunk_ref; // file contents from host_chunk_base
+static uint64_t host_chunk_base;
+static size_t host_chunk_size;
+static uint64_t host_chunk_next;
+static uint64_t host_chunk_end;
+
+status_t host_chunk_check(void* arg, uint64_t offset, void* data, size_t length){ // every chunk but the last has the full size
+	if(offset != host_chunk_next || (length != host_chunk_size && offset + length != host_chunk_end) || memcmp(host_chunk_ref + (offset - host_chunk_base), data, length) != 0)
+		(*((int*) arg))++;
+	host_chunk_next = offset + length;
+	return TSX_SUCCESS;
+}
+
+int host_chunked(char* src, uint64_t offset, size_t chunkSize){
+	size_t size = 0;
+	host_chunk_ref = host_load(src, "boot/initrd", &size);
+	if(!host_chunk_ref)
+		return 1;
+	int fails = 0;
+	host_chunk_base = 0;
+	host_chunk_size = chunkSize;
+	host_chunk_next = offset;
+	host_chunk_end = size;
+	if(vfs_readFileChunked(HOST_DRIVE, 0, "/boot/initrd", offset, size - offset, chunkSize, host_chunk_check, &fails) != TSX_SUCCESS ||
+		host_chunk_next != size)
+		fails++;
+	free(host_chunk_ref);
+	return fails;
+}
+
+int host_scenario_chunked(char* src){
+	return host_chunked(src, 0, 0x40000);
+}
+
+int host_scenario_chunked_small(char* src){ // chunks that fit in the scratch arena
+	return host_chunked(src, 0, 0x4000);
+}
+
+int host_scenario_chunked_unaligned(char* src){ // every chunk ends inside a block
+	return host_chunked(src, 1000, 0x4000);
+}
+
+int host_scenario_map(char* src){
+	size_t size = 0;
+	char* ref = host_load(src, "boot/kernel", &size);
+	if(!ref)
+		return 1;
+	ext_file_run* runs = NULL;
+	size_t count = 0;
+	int fails = 0;
+	if(vfs_getFileMap(HOST_DRIVE, 0, "/boot/kernel", &runs, &count) != TSX_SUCCESS){
+		free(ref);
+		return 1;
+	}
+	uint64_t covered = 0;
+	for(size_t i = 0; i < count; i++){
+		char* data = malloc(runs[i].sectors * 512);
+		for(uint64_t s = 0; s < runs[i].sectors; s += 0x80)
+			msio_read_drive(HOST_DRIVE, runs[i].lba + s, MIN(0x80, runs[i].sectors - s), (size_t) data + s * 512);
+		size_t length = MIN(runs[i].sectors * 512, size - runs[i].offset);
+		if(memcmp(data, ref + runs[i].offset, length) != 0)
+			fails++;
+		covered += length;
+		free(data);
+	}
+	if(covered != size) // the kernel has no holes
+		fails++;
+	if(count > 0)
+		kfree(runs, count * sizeof(ext_file_run));
+	free(ref);
+	return fails;
+}
+
+int host_scenario_prealloc(char* src){ // unwritten extents, only some images have them
+	size_t size = 0;
+	status_t status = vfs_getFileSize(HOST_DRIVE, 0, "/boot/prealloc", &size);
+	if(status == TSX_NO_SUCH_FILE)
+		return 0;
+	if(status != TSX_SUCCESS || size != 4000000)
+		return 1;
+	ext_mount* mount = ext_mount_find(HOST_DRIVE, 0);
+	uint64_t zeroFilled = mount->stats.zeroFilledBytes;
+	int fails = 0;
+	char* data = malloc(size);
+	memset(data, 0xcc, size);
+	if(vfs_readFile(HOST_DRIVE, 0, "/boot/prealloc", (size_t) data) != TSX_SUCCESS)
+		fails++;
+	for(size_t i = 0; i < size && !fails; i++){
+		if(data[i] != 0)
+			fails++;
+	}
+	if(mount->stats.zeroFilledBytes - zeroFilled != size) // not read from the device
+		fails++;
+	free(data);
+	return fails;
+}
+
+int host_scenario_huge(char* src){ // a sparse file over 4 GiB with data across the 4 GiB boundary
+	uint64_t gib = 1024 * 1024 * 1024;
+	uint64_t size = 5 * gib;
+	size_t sizeRead = 0;
+	if(vfs_getFileSize(HOST_DRIVE, 0, "/boot/huge", &sizeRead) != TSX_SUCCESS || sizeRead != size)
+		return 1;
+	int fails = 0;
+	uint64_t offsets[] = {0, 4 * gib - 6000, 4 * gib - 4096, 4 * gib - 1, 4 * gib + 4000, size - 10000, size - 3};
+	for(size_t i = 0; i < sizeof(offsets) / sizeof(uint64_t); i++){
+		size_t length = MIN(20000, size - offsets[i]);
+		char* ref = host_load_range(src, "boot/huge", offsets[i], length);
+		char* data = malloc(length);
+		size_t got = 0;
+		if(!ref || vfs_readFileRange(HOST_DRIVE, 0, "/boot/huge", offsets[i], length, (size_t) data, &got) != TSX_SUCCESS || got != length ||
+			memcmp(data, ref, length) != 0)
+			fails++;
+		free(data);
+		free(ref);
+	}
+	host_chunk_base = 4 * gib - 10001;
+	host_chunk_size = 0x1000;
+	host_chunk_next = host_chunk_base;
+	host_chunk_end = host_chunk_base + 20000;
+	host_chunk_ref = host_load_range(src, "boot/huge", host_chunk_base, 20000);
+	if(!host_chunk_ref || vfs_readFileChunked(HOST_DRIVE, 0, "/boot/huge", host_chunk_base, 20000, 0x1000, host_chunk_check, &fails) != TSX_SUCCESS ||
+		host_chunk_next != host_chunk_base + 20000)
+		fails++;
+	free(host_chunk_ref);
+	return fails;
+}
+
+int host_read_csum(char* src, char* path){ // 0 if path reads correctly, or fails to read on a corrupted image
+	char fsPath[256];
+	snprintf(fsPath, sizeof(fsPath), "/%s", path);
+	size_t refSize = 0;
+	char* ref = host_load(src, path, &refSize);
+	size_t size = 0;
+	status_t status = vfs_getFileSize(HOST_DRIVE, 0, fsPath, &size);
+	char* data = malloc(refSize);
+	if(status == TSX_SUCCESS)
+		status = size == refSize ? vfs_readFile(HOST_DRIVE, 0, fsPath, (size_t) data) : TSX_ERROR;
+	int fail;
+	if(host_corrupt)
+		fail = status == TSX_SUCCESS;
+	else
+		fail = !ref || status != TSX_SUCCESS || memcmp(data, ref, refSize) != 0;
+	if(fail)
+		printf("  %s: status %zu\n", fsPath, status);
+	free(data);
+	free(ref);
+	return fail;
+}
+
+int host_scenario_checksum(char* src){ // a damaged directory block and a damaged inode
+	return host_read_csum(src, "csum/dir/file") + host_read_csum(src, "csum/inode");
+}
+
+#if EXT_BOOT_PLAN
+void host_touch_superblock(){ // what mounting the filesystem read-write elsewhere does: a new s_wtime
+	ext_superblock* sb = malloc(1024);
+	msio_read_drive(HOST_DRIVE, 2, 2, (size_t) sb);
+	sb->s_wtime++;
+	if(sb->s_feature_ro_compat & EXT_RO_COMPAT_METADATA_CSUM)
+		sb->s_checksum = ext_crc32c(0xffffffff, sb, offsetof(ext_superblock, s_checksum));
+	msio_write_drive(HOST_DRIVE, 2, 2, (size_t) sb);
+	free(sb);
+}
+
+int host_scenario_plan(char* src){ // one boot records the plan, the next one reads everything through it without writing
+	int fails = 0;
+	ext_invalidate(NULL, 0);
+	fails += host_read_all(src);
+	host_touch_superblock();
+	ext_invalidate(NULL, 0);
+	fails += host_read_all(src);
+	ext_mount* mount = ext_mount_find(HOST_DRIVE, 0);
+	if(!mount || mount->stats.planHits < 40 || mount->stats.planWrites != 0){
+		printf("  plan hits %zu, writes %zu\n", mount ? (size_t) mount->stats.planHits : 0, mount ? (size_t) mount->stats.planWrites : 0);
+		fails++;
+	}
+	return fails;
+}
+#endif
+
+
+static struct{
+	char* name;
+	host_scenario run;
+} host_scenarios[] = {
+	{"probe", host_scenario_probe},
+	{"read-cold", host_scenario_read_cold},
+	{"read-warm", host_scenario_read_warm},
+	{"symlink", host_scenario_symlink},
+	{"lookup", host_scenario_lookup},
+	{"list", host_scenario_list},
+	{"list-plus", host_scenario_list_plus},
+	{"batch", host_scenario_batch},
+	{"range", host_scenario_range},
+	{"chunked", host_scenario_chunked},
+	{"chunked-16k", host_scenario_chunked_small},
+	{"chunked-odd", host_scenario_chunked_unaligned},
+	{"map", host_scenario_map},
+	{"prealloc", host_scenario_prealloc},
+	{"huge", host_scenario_huge},
+	{"checksum", host_scenario_checksum},
+#if EXT_BOOT_PLAN
+	{"plan", host_scenario_plan},
+#endif
+	{NULL, NULL}
+};
+
+int main(int argc, char** argv){
+	if(argc < 3){
+		fprintf(stderr, "usage: %s <image> <source tree> [-v] [-corrupt]\n", argv[0]);
+		return 2;
+	}
+	if(host_open_image(argv[1]) != TSX_SUCCESS){
+		fprintf(stderr, "%s: cannot open\n", argv[1]);
+		return 2;
+	}
+	bool verbose = FALSE;
+	for(int i = 3; i < argc; i++){
+		if(strcmp(argv[i], "-v") == 0)
+			verbose = TRUE;
+		else if(strcmp(argv[i], "-corrupt") == 0)
+			host_corrupt = TRUE;
+	}
+	printf("%s%s\n", argv[1], EXT_BOOT_PLAN ? " (boot plan)" : "");
+	printf("  %-11s %-6s %8s %10s %10s %10s %10s\n", "scenario", "result", "commands", "sectors", "peak heap", "heap calls", "time (ms)");
+	int failed = 0;
+	for(size_t i = 0; host_scenarios[i].name; i++){
+		host_count.commands = 0;
+		host_count.sectors = 0;
+		host_count.heapPeak = host_count.heapBytes;
+		host_count.heapCalls = 0;
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		int fails = host_scenarios[i].run(argv[2]);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+		printf("  %-11s %-6s %8zu %10zu %10zu %10zu %10.2f\n", host_scenarios[i].name, fails ? "FAIL" : "ok", host_count.commands, host_count.sectors,
+			host_count.heapPeak, host_count.heapCalls, ms);
+		if(fails)
+			failed++;
+	}
+	if(verbose){
+		host_log = TRUE;
+		ext_io_dump(HOST_DRIVE, 0);
+	}
+	ext_invalidate(NULL, 0);
+	host_close_image();
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * host.c - kernel interface for fs/ext built as a host program: a disk image as the only drive, the C heap, and counters.
+ */
+
+#include <time.h>
+#include <stdarg.h>
+#include "host.h"
+
+bool host_log = FALSE;
+host_counters host_count;
+
+static FILE* host_image = NULL;
+
+
+status_t host_open_image(char* path){
+	host_image = fopen(path, "r+b");
+	return host_image ? TSX_SUCCESS : TSX_NO_DEVICE;
+}
+
+void host_close_image(){
+	if(host_image)
+		fclose(host_image);
+	host_image = NULL;
+}
+
+void host_heap_add(size_t size){
+	host_count.heapBytes += size;
+	host_count.heapCalls++;
+	if(host_count.heapBytes > host_count.heapPeak)
+		host_count.heapPeak = host_count.heapBytes;
+}
+
+void* kmalloc(size_t size){
+	void* ptr = malloc(size ? size : 1);
+	if(!ptr)
+		return NULL;
+	memset(ptr, 0xcc, size); // catch reads of uninitialized memory
+	host_heap_add(size);
+	return ptr;
+}
+
+void kfree(void* ptr, size_t size){
+	host_count.heapBytes -= size;
+	free(ptr);
+}
+
+void* kmalloc_aligned(size_t size){
+	void* ptr = aligned_alloc(4096, (size + 4095) & ~((size_t) 4095));
+	if(!ptr)
+		return NULL;
+	memset(ptr, 0xcc, size);
+	host_heap_add(size);
+	return ptr;
+}
+
+void kfree_aligned(void* ptr, size_t size){
+	host_count.heapBytes -= size;
+	free(ptr);
+}
+
+void host_log_print(char* level, char* format, ...){
+	if(!host_log)
+		return;
+	va_list args;
+	va_start(args, format);
+	fputs(level, stdout);
+	for(char* c = format; *c; c++){
+		if(*c != '%' || !c[1]){
+			putchar(*c);
+			continue;
+		}
+		c++;
+		switch(*c){
+			case 's': fputs(va_arg(args, char*), stdout); break;
+			case 'c': putchar(va_arg(args, int)); break;
+			case 'u': printf("%zu", va_arg(args, size_t)); break;
+			case 'd': printf("%ld", (long) va_arg(args, size_t)); break;
+			case 'x': printf("%zx", va_arg(args, size_t)); break;
+			case 'X':
+			case 'Y': printf("%zX", va_arg(args, size_t)); break;
+			default: putchar('%'); putchar(*c); break;
+		}
+	}
+	va_end(args);
+}
+
+void reloc_ptr(void** ptr){
+}
+
+void del_reloc_ptr(void** ptr){
+}
+
+size_t util_math_pow(size_t base, size_t exp){
+	size_t result = 1;
+	while(exp--)
+		result *= base;
+	return result;
+}
+
+size_t arch_time(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+status_t msio_read_drive(char* driveLabel, uint64_t lba, uint16_t count, size_t dest){
+	host_count.commands++;
+	host_count.sectors += count;
+	if(!host_image || count == 0 || fseek(host_image, lba * 512, SEEK_SET) != 0)
+		return TSX_ERROR;
+	size_t read = fread((void*) dest, 512, count, host_image);
+	if(read < count) // past the end of the image
+		memset((void*) (dest + read * 512), 0, (count - read) * 512);
+	return TSX_SUCCESS;
+}
+
+status_t msio_write_drive(char* driveLabel, uint64_t lba, uint16_t count, size_t source){
+	host_count.commands++;
+	host_count.sectors += count;
+	if(!host_image || fseek(host_image, lba * 512, SEEK_SET) != 0 || fwrite((void*) source, 512, count, host_image) != count)
+		return TSX_ERROR;
+	fflush(host_image);
+	return TSX_SUCCESS;
+}
+
+list_array* list_array_create(size_t capacity){
+	return calloc(1, sizeof(list_array));
+}
+
+status_t list_array_push(list_array* list, void* element){
+	if(list->length == list->capacity){
+		size_t capacity = list->capacity ? list->capacity * 2 : 8;
+		void** data = realloc(list->data, capacity * sizeof(void*));
+		if(!data)
+			return TSX_OUT_OF_MEMORY;
+		list->data = data;
+		list->capacity = capacity;
+	}
+	list->data[list->length++] = element;
+	return TSX_SUCCESS;
+}
+
+void* list_array_get(list_array* list, size_t index){
+	return list->data[index];
+}
+
+void list_array_delete(list_array* list){
+	free(list->data);
+	free(list);
+}
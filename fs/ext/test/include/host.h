@@ -0,0 +1,81 @@
+/*
+ * host.h - declarations of the kernel interface used by fs/ext, implemented by host.c for building ext.c as a host program.
+ * Every kernel header included by ext.c maps to this file.
+ */
+
+#ifndef __EXT_TEST_HOST_H__
+#define __EXT_TEST_HOST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef uint8_t bool;
+#define TRUE 1
+#define FALSE 0
+#define true 1
+#define false 0
+
+typedef size_t status_t;
+#define TSX_SUCCESS 0
+#define TSX_ERROR 1
+#define TSX_OUT_OF_MEMORY 2
+#define TSX_NO_SUCH_FILE 3
+#define TSX_NO_SUCH_DIRECTORY 4
+#define TSX_TOO_LARGE 5
+#define TSX_INVALID_FORMAT 6
+#define TSX_UNSUPPORTED 7
+#define TSX_NO_DEVICE 8
+
+#define FERROR(x) {status = (x); goto _end;}
+#define CERROR() {if(status != TSX_SUCCESS) goto _end;}
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+typedef struct list_array{
+	size_t length;
+	size_t capacity;
+	void** data;
+} list_array;
+
+void* kmalloc(size_t size);
+void kfree(void* ptr, size_t size);
+void* kmalloc_aligned(size_t size);
+void kfree_aligned(void* ptr, size_t size);
+void reloc_ptr(void** ptr);
+void del_reloc_ptr(void** ptr);
+
+size_t util_math_pow(size_t base, size_t exp);
+size_t arch_time();
+
+status_t msio_read_drive(char* driveLabel, uint64_t lba, uint16_t count, size_t dest);
+status_t msio_write_drive(char* driveLabel, uint64_t lba, uint16_t count, size_t source);
+
+list_array* list_array_create(size_t capacity);
+status_t list_array_push(list_array* list, void* element);
+void* list_array_get(list_array* list, size_t index);
+void list_array_delete(list_array* list);
+
+extern bool host_log;
+// printed only if host_log is set; the format is that of the kernel log, integers are passed as size_t
+void host_log_print(char* level, char* format, ...);
+#define log_debug(...) host_log_print("[debug] ", __VA_ARGS__)
+#define log_info(...) host_log_print("[info] ", __VA_ARGS__)
+
+// everything the harness measures, reset per scenario
+typedef struct host_counters{
+	size_t commands; // msio_read_drive and msio_write_drive calls
+	size_t sectors;
+	size_t heapBytes; // current kmalloc use, including memory handed to the caller
+	size_t heapPeak;
+	size_t heapCalls;
+} host_counters;
+
+extern host_counters host_count;
+
+status_t host_open_image(char* path);
+void host_close_image();
+
+#endif /* __EXT_TEST_HOST_H__ */
@@ -0,0 +1,93 @@
+#!/bin/sh
+# mkimages.sh - generates the source tree and the ext2/3/4 images used by the fs/ext host harness
+# usage: mkimages.sh <output directory>
+set -e
+
+OUT=${1:?usage: mkimages.sh <output directory>}
+SRC=$OUT/src
+mkdir -p "$OUT"
+rm -rf "$SRC" "$OUT"/*.img
+mkdir -p "$SRC/boot/modules" "$SRC/boot/many" "$SRC/etc" "$SRC/csum/dir"
+
+head -c 5000000 /dev/urandom > "$SRC/boot/kernel"
+head -c 12345678 /dev/urandom > "$SRC/boot/initrd"
+head -c 3 /dev/urandom > "$SRC/boot/tiny"
+: > "$SRC/boot/empty"
+echo "hello config" > "$SRC/etc/conf"
+i=1
+while [ $i -le 40 ]; do
+	head -c $((i * 1000 + 17)) /dev/urandom > "$SRC/boot/modules/mod$i.ko"
+	i=$((i + 1))
+done
+i=1
+while [ $i -le 3000 ]; do
+	echo "f$i" > "$SRC/boot/many/file_with_long_name_$i.txt"
+	i=$((i + 1))
+done
+# holes at the start, middle and end
+truncate -s 3000000 "$SRC/boot/sparse"
+printf 'start' | dd of="$SRC/boot/sparse" conv=notrunc 2>/dev/null
+printf 'mid' | dd of="$SRC/boot/sparse" bs=1 seek=1500000 conv=notrunc 2>/dev/null
+printf 'end' | dd of="$SRC/boot/sparse" bs=1 seek=2999997 conv=notrunc 2>/dev/null
+# over 4 GiB, with data across the 4 GiB boundary
+truncate -s 5G "$SRC/boot/huge"
+head -c 10000 /dev/urandom | dd of="$SRC/boot/huge" bs=1 seek=$((4 * 1024 * 1024 * 1024 - 5000)) conv=notrunc 2>/dev/null
+printf 'end' | dd of="$SRC/boot/huge" bs=1 seek=$((5 * 1024 * 1024 * 1024 - 3)) conv=notrunc 2>/dev/null
+# metadata that is corrupted in the _corrupt image: a directory block and an inode
+head -c 3000 /dev/urandom > "$SRC/csum/dir/file"
+head -c 3000 /dev/urandom > "$SRC/csum/inode"
+# boot plan for builds with EXT_BOOT_PLAN, it must not be all zeros or it is stored as a hole
+yes sxboot | head -c 16384 > "$SRC/boot/sxboot.plan"
+ln -s ../etc/conf "$SRC/boot/conflink"
+ln -s /boot/modules "$SRC/modlink"
+
+# one 4K piece every 8K, written after the image is created so that it gets many extents (a deep tree on ext4)
+FRAG=$OUT/frag
+: > "$FRAG"
+i=0
+while [ $i -lt 3000 ]; do
+	head -c 4096 /dev/urandom | dd of="$FRAG" bs=4096 seek=$((i * 2)) conv=notrunc 2>/dev/null
+	i=$((i + 1))
+done
+cp "$FRAG" "$SRC/boot/frag"
+
+mkimage(){
+	name=$1
+	shift
+	mke2fs -q -F "$@" -d "$SRC" "$OUT/$name.img" 64M
+	debugfs -w -R "rm /boot/frag" "$OUT/$name.img" >/dev/null 2>&1
+	debugfs -w -R "write $FRAG /boot/frag" "$OUT/$name.img" >/dev/null 2>&1
+	# index the large directory
+	e2fsck -fyD "$OUT/$name.img" >/dev/null 2>&1 || true
+}
+
+# unwritten extents: 1000 preallocated blocks, read as zeros
+prealloc(){
+	debugfs -w -R "write /dev/null /boot/prealloc" "$OUT/$1.img" >/dev/null 2>&1
+	debugfs -w -R "fallocate /boot/prealloc 0 999" "$OUT/$1.img" >/dev/null 2>&1
+	debugfs -w -R "sif /boot/prealloc size 4000000" "$OUT/$1.img" >/dev/null 2>&1
+}
+
+mkimage ext2_1k -t ext2 -b 1024
+mkimage ext2_4k -t ext2 -b 4096
+mkimage ext3_4k -t ext3 -b 4096
+mkimage ext4_1k -t ext4 -b 1024
+mkimage ext4_4k -t ext4 -b 4096
+mkimage ext4_128 -t ext4 -b 4096 -I 128
+mkimage ext4_nocsum -t ext4 -b 4096 -O ^metadata_csum,^64bit
+mkimage ext4_metabg -t ext4 -b 4096 -O 64bit,meta_bg,^resize_inode
+mkimage ext4_inline -t ext4 -b 4096 -O inline_data
+mkimage ext4_largedir -t ext4 -b 1024 -O large_dir
+prealloc ext4_4k
+prealloc ext4_1k
+prealloc ext4_metabg
+
+# checksum failures that must be reported instead of returning the corrupted data
+cp "$OUT/ext4_4k.img" "$OUT/ext4_corrupt.img"
+corrupt(){ # corrupt <byte offset>
+	printf '\377' | dd of="$OUT/ext4_corrupt.img" bs=1 seek=$1 conv=notrunc 2>/dev/null
+}
+dirblock=$(debugfs -R "blocks /csum/dir" "$OUT/ext4_corrupt.img" 2>/dev/null | awk '{print $1}')
+corrupt $((dirblock * 4096 + 30))
+location=$(debugfs -R "imap /csum/inode" "$OUT/ext4_corrupt.img" 2>/dev/null | sed -n 's/.*located at block \([0-9]*\), offset \(0x[0-9a-f]*\).*/\1 \2/p')
+corrupt $(($(echo $location | cut -d' ' -f1) * 4096 + $(echo $location | cut -d' ' -f2) + 0x10))